@@ -77,18 +77,33 @@ void reuse_port (int s) {
 #endif
 }
 
+// pipelined requests are small writes that should not wait for the
+// acknowledgement of earlier requests (Nagle's algorithm)
+void no_delay (int s) {
+  int enable = 1;
+  if (setsockopt (s, IPPROTO_TCP, TCP_NODELAY,
+		  (const char*)&enable, sizeof(enable)) < 0)
+    print_error ("no_delay");
+}
+
 int bsd_socket (int family) {
   int s = socket (family, SOCK_STREAM, IPPROTO_TCP);
   if (s < 0) print_error ("bsd_socket");
-  else { reuse_address (s); reuse_port (s); }
+  else { reuse_address (s); reuse_port (s); no_delay (s); }
   return s;
 }
 
+int bsd_backlog = 100;
+
+#define ACCEPT_RETRY 100 // ms, delay after running out of descriptors
+
+void net_backlog (int backlog) { bsd_backlog = backlog; }
+
 int bsd_listen (Address *address) {
   int s = bsd_socket (address->family);
   if (bind (s, (struct sockaddr *)address, address->length) < 0)
     print_error ("bsd_listen");
-  listen (s, 100);
+  listen (s, bsd_backlog);
   return s;
 }
 
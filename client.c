@@ -12,7 +12,11 @@
 /** @brief Perform polling on the behalf of a client.
 
     Returns SERVICE_FOUND with a pointer to a Service as the event object when
-    a the service discovery returns a discovers a new service.
+    a the service discovery returns a discovers a new service. TCP_WRITABLE
+    events are handled by flushing the data queued on the HttpConnection.
+    SE_IDLE and SE_RECONNECT events are handled, TCP_CLOSED and TCP_TIMEOUT
+    start the reconnect backoff (see @ref se_closed), TCP_CLOSED is not
+    returned for a connection closed while idle.
     @param any receives the event object pointer.
     @param timeout is the polling timeout in milliseconds, or -1 to indicate
     an infitie timeout.
@@ -39,8 +43,17 @@ int client_poll (void **any, int timeout) {
   }
   switch (event = event_poll (any, timeout)) {
   case TCP_CONNECT: return TCP_PORT;
+  case TCP_WRITABLE: // continue a TLS handshake or flush queued data
+    if (conn_session (*any)) http_flush (*any);
+    goto top;
   case UDP_PORT:
     if (s = service_receive (*any)) goto top;
+    break;
+  case TCP_CLOSED: case TCP_TIMEOUT:
+    if (se_closed (*any)) goto top;
+    break;
+  case SE_IDLE: se_idle (*any); goto top;
+  case SE_RECONNECT: se_redial (*any); goto top;
   } return event;
 }
 
@@ -113,12 +113,12 @@ void options (int argc, char **argv) {
     load_cert_dir ("certs");
   }
   // process tests
-  while (i < argc) { uint64_t sfdi;
+  while (i < argc) { uint64_t sfdi; int budget, deadline, rate, idle;
     const char * const commands[] =
       {"sfdi", "edev", "fsa", "register", "pin", "primary", "all", "time",
        "self", "subscribe", "metering", "meter", "alarm", "poll", "load",
-       "device", "delete", "inverter"};
-    switch (string_index (argv[i], commands, 18)) {
+       "device", "delete", "inverter", "stats", "deadline", "rate", "idle"};
+    switch (string_index (argv[i], commands, 22)) {
     case 0: // sfdi
       if (++i == argc || !number64 (&device_sfdi, argv[i])) {
 	printf ("sfdi command expects number argument\n"); exit (0);
@@ -172,6 +172,23 @@ void options (int argc, char **argv) {
       } test |= GET_EDEV | DELETE_DEVICE; break;
     case 17: // inverter
       test |= INVERTER_CLIENT; break;
+    case 18: // stats
+      if (++i == argc || !number (&budget, argv[i])) {
+	printf ("stats command expects a budget in milliseconds\n"); exit (0);
+      } event_stats_enable (budget); event_stats_signal (SIGUSR1); break;
+    case 19: // deadline
+      if (++i == argc || !number (&deadline, argv[i])) {
+	printf ("deadline command expects a time in milliseconds\n"); exit (0);
+      } http_default_deadline (deadline); break;
+    case 20: // rate
+      if (++i == argc || !number (&rate, argv[i])) {
+	printf ("rate command expects a number of requests per second\n");
+	exit (0);
+      } se_rate_limit (rate, rate); break;
+    case 21: // idle
+      if (++i == argc || !number (&idle, argv[i])) {
+	printf ("idle command expects a time in seconds\n"); exit (0);
+      } se_idle_timeout (idle); break;
     default:
       printf ("unknown command \"%s\"\n", argv[i]); exit (0);
     }
@@ -510,12 +527,10 @@ int main (int argc, char **argv) {
 	// else process_notifications (any, test_dep);
       }
       break;
-    case TCP_TIMEOUT:
-      cleanup_http (any);
-      printf ("Connection timed out\n"); return 0;
-    case TCP_CLOSED:
-      cleanup_http (any);
-      printf ("Connection closed\n"); return 0;
+    case HTTP_TIMEOUT: retry_http (any); break;
+    // client connections reconnect after a backoff (see se_closed)
+    case TCP_TIMEOUT: printf ("Connection timed out\n"); break;
+    case TCP_CLOSED: printf ("Connection closed\n"); break;
     case DEVICE_SCHEDULE:
       print_event_schedule (any); break;
     case EVENT_START:
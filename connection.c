@@ -44,6 +44,17 @@ int conn_read (void *conn, char *buffer, int size);
  */
 int conn_write (void *conn, const char *data, int length);
 
+/** @brief Write a vector of buffers to a Connection.
+
+    For a TCP connection the buffers are written with a single gather write,
+    for a TLS connection small buffers are coalesced into TLS records.
+    @param conn is a pointer to a Connection
+    @param iov is an array of buffers
+    @param n is the number of buffers
+    @returns the length of the data written or -1 on failure
+ */
+int conn_writev (void *conn, const struct iovec *iov, int n);
+
 /** @brief Close a Connection.
 
     Send a TLS alert for a TLS connection, and send RST for a TCP connection.
@@ -81,6 +92,19 @@ void *conn_accept (void *conn, Acceptor *a, int secure);
 */
 void *conn_connect (void *conn, Address *server, int secure);
 
+/** @brief Connect to the first of several server addresses to respond.
+
+    The same as @ref conn_connect, but races the TCP connection attempts (see
+    @ref net_connect_any), the TLS handshake starts on the connection that
+    wins the race.
+    @param conn is a pointer to a Connection
+    @param servers is an array of addresses of a TCP/TLS server
+    @param n is the number of addresses
+    @param secure is 1 for a TLS connection, 0 for a TCP connection
+    @returns the value conn
+*/
+void *conn_connect_any (void *conn, Address *servers, int n, int secure);
+
 /** @brief Get the TLS session ID.
     
     The session ID is a 32 byte value that identifies a client/server session.
@@ -89,6 +113,25 @@ void *conn_connect (void *conn, Address *server, int secure);
  */
 const uint8_t *tls_session_id (void *conn);
 
+/** @brief Was the TLS session resumed?
+
+    A client resumes a session kept from an earlier connection to the same
+    server (see @ref tls_session_cache), the handshake is abbreviated.
+    @param conn is a pointer to a Connection
+    @returns 1 if the session was resumed, 0 otherwise
+*/
+int tls_resumed (void *conn);
+
+/** @brief Get the LFDI of the peer certificate.
+
+    The LFDI is kept with the result of verifying the certificate (see
+    @ref tls_verify_cache), so it is computed once for a peer.
+    @param conn is a pointer to a Connection
+    @param lfdi is a 20 byte buffer that stores the LFDI
+    @returns 1 for a TLS connection with a peer certificate, 0 otherwise
+*/
+int tls_peer_lfdi (void *conn, uint8_t *lfdi);
+
 /** @} */
 
 #ifndef HEADER_ONLY
@@ -98,10 +141,13 @@ enum TlsState {TLS_NONE, TLS_NEGOTIATE, TLS_SHUTDOWN, TLS_SESSION};
 typedef struct _Connection {
   TcpPort tcp;
   void *tls;
+  void *tls_job; // a handshake step run by a worker
+  int tls_err; // the last TLS error (SSL_get_error)
   unsigned tls_state : 2;
   int (*session) (void *);
   int (*read) (void *, char *, int);
   int (*write) (void *, const char *, int);
+  int (*writev) (void *, const struct iovec *, int);
   void (*close) (void *);
 } Connection;
 
@@ -114,6 +160,9 @@ int conn_read (void *conn, char *buffer, int size) {
 int conn_write (void *conn, const char *data, int length) {
   return conn_field (conn, write (conn, data, length));
 }
+int conn_writev (void *conn, const struct iovec *iov, int n) {
+  return conn_field (conn, writev (conn, iov, n));
+}
 int conn_secure (void *conn) { return conn_field (conn, tls) != NULL; }
 void conn_close (void *conn) { conn_field (conn, close (conn)); }
 
@@ -124,7 +173,7 @@ int tcp_session (void *conn) {
 void tcp_setup (Connection *c) {
   c->tls = NULL; c->session = tcp_session;
   c->read = net_read; c->write = net_write;
-  c->close = net_close;
+  c->writev = net_writev; c->close = net_close;
 }
 
 const uint8_t *tls_session_id (void *conn) {
@@ -133,14 +182,24 @@ const uint8_t *tls_session_id (void *conn) {
   return NULL;
 }
 
+int tls_resumed (void *conn) {
+  Connection *c = conn;
+  return c->tls? ssl_resumed (c->tls) : 0;
+}
+
+int tls_peer_lfdi (void *conn, uint8_t *lfdi) {
+  Connection *c = conn;
+  return c->tls? ssl_peer_lfdi (c->tls, lfdi) : 0;
+}
+
 int tls_session (void *conn) {
   Connection *c = conn;
   if (net_status (c) == Connected) {
     switch (c->tls_state) {
     case TLS_NEGOTIATE:
-    if (ssl_handshake (c->tls)) {
+    if (ssl_handshake (c->tls, &c->tls_job, &c->tls_err)) {
       c->tls_state = TLS_SESSION; return SESSION_NEW;
-    } else if (!ssl_pending ()) {
+    } else if (!ssl_pending (c->tls_err)) {
       c->tls_state = TLS_SHUTDOWN;
       print_ssl_error ("tls_session");
     } else break;
@@ -157,15 +216,17 @@ int tls_session (void *conn) {
 
 void tls_close (void *conn) {
   Connection *c = conn;
-  c->tls_state = TLS_SHUTDOWN;
+  if (ssl_release (c->tls, &c->tls_job)) { // a worker frees the SSL
+    c->tls = NULL; c->tls_state = TLS_NONE; net_close (c); return;
+  } c->tls_state = TLS_SHUTDOWN;
   tls_session (c);
 }
 
 int tls_read (void *conn, char *data, int length) {
   Connection *c = conn; int ret = -1;
   if (c->tls_state == TLS_SESSION) {
-    ret = ssl_read (c->tls, data, length);
-    if (ret <= 0 && !ssl_pending ()) tls_close (conn);
+    ret = ssl_read (c->tls, data, length, &c->tls_err);
+    if (ret <= 0 && !ssl_pending (c->tls_err)) tls_close (conn);
   }
   return ret;
 }
@@ -173,16 +234,38 @@ int tls_read (void *conn, char *data, int length) {
 int tls_write (void *conn, const char *data, int length) {
   Connection *c = conn; int ret = -1;
   if (c->tls_state == TLS_SESSION) {
-    ret = ssl_write (c->tls, data, length);
-    if (ret <= 0 && !ssl_pending ()) tls_close (conn);
+    ret = ssl_write (c->tls, data, length, &c->tls_err);
+    if (ret <= 0 && !ssl_pending (c->tls_err)) tls_close (conn);
   }
   return ret;
 }
 
+// maximum TLS record payload, smaller buffers are coalesced up to this size
+#define TLS_RECORD 16384
+
+int tls_writev (void *conn, const struct iovec *iov, int n) {
+  char buffer[TLS_RECORD]; const char *data;
+  int i = 0, total = 0, length, ret;
+  while (i < n) { length = 0;
+    while (i < n && length + iov[i].iov_len <= TLS_RECORD) {
+      memcpy (buffer+length, iov[i].iov_base, iov[i].iov_len);
+      length += iov[i++].iov_len;
+    }
+    if (length) data = buffer;
+    else { data = iov[i].iov_base; length = iov[i++].iov_len; }
+    if ((ret = tls_write (conn, data, length)) <= 0)
+      return total? total : ret;
+    total += ret;
+  } return total;
+}
+
 void tls_setup (Connection *c) {
-  c->tls = ssl_new (c); c->session = tls_session;
+  // a connection closed without a shutdown
+  if (c->tls && !ssl_release (c->tls, &c->tls_job)) ssl_free (c->tls);
+  c->tls = ssl_new (c); c->tls_job = NULL; c->tls_err = 0;
+  c->session = tls_session;
   c->read = tls_read; c->write = tls_write;
-  c->close = tls_close;
+  c->writev = tls_writev; c->close = tls_close;
   c->tls_state = TLS_NEGOTIATE;
 }
 
@@ -198,4 +281,10 @@ void *conn_connect (void *conn, Address *server, int secure) {
   else tcp_setup (c); return conn;
 }
 
+void *conn_connect_any (void *conn, Address *servers, int n, int secure) {
+  Connection *c = conn; net_connect_any (conn, servers, n);
+  if (secure) { tls_setup (conn); ssl_connect (c->tls); }
+  else tcp_setup (c); return conn;
+}
+
 #endif
@@ -73,6 +73,7 @@ int der_poll (void **any, int timeout) {
       } break;
     case RESOURCE_POLL: poll_resource (*any);
     case RESOURCE_UPDATE: update_resource (*any); break;
+    case RESOURCE_RETRY: retry_resource (*any); break;
     case RESOURCE_REMOVE:
       if (se_event (resource_type (*any)))
 	delete_blocks (*any);
@@ -58,7 +58,8 @@ void print_dns_name (char *name);
 typedef struct _Host {
   struct _Host *next;
   char *name;
-  Address addr;
+  Address addr; // IPv6 address if known, otherwise IPv4
+  Address alt; // IPv4 address when addr is IPv6, raced with addr
 } Host;
 
 typedef struct _Service {
@@ -211,6 +212,7 @@ void print_service (Service *s) {
   printf ("  name: "); print_dns_name (s->name);
   printf ("\n  target: "); print_dns_name (h->name);
   printf ("\n  host: "); print_host (&h->addr);
+  if (h->alt.length) { printf (", "); print_host (&h->alt); }
   printf ("\n  port: %d\n", s->port);
   printf ("  time to live: %d\n", s->ttl);
   if (s->txt) {
@@ -221,29 +223,32 @@ void print_service (Service *s) {
 // process A resource record (IPv4)
 void *host_a (Host *h, char *data, int length) {
   ok (length == 4); data += 10;
-  ipv4_address (&h->addr, UNPACK32 (data), 0);
+  ipv4_address (h->addr.family == AF_INET6? &h->alt : &h->addr,
+		UNPACK32 (data), 0);
   return data;
 }
 
-// process AAAA resource record (IPv6)
+// process AAAA resource record (IPv6), an IPv4 address becomes the alternate
 void *host_aaaa (Host *h, char *data, int length) {
   ok (length == 16); data += 10;
+  if (h->addr.length && h->addr.family != AF_INET6)
+    address_copy (&h->alt, &h->addr);
   ipv6_address (&h->addr, data, 0);
   return data;
 }
 
 // process SRV resource record (RFC 2782)
 void *dns_srv (Service *s, char *data) {
-  char target[256]; int length;
+  char target[256], *rr; int length;
   s->ttl = rr_ttl (data);
   s->port = UNPACK16 (data+10+4);
   ok (dns_name (target, data+10+6));
   if (!s->host) s->host = get_host (target);
-  if (data = dns_find (target, &length, AAAA_RECORD))
-    host_aaaa (s->host, data, length);
-  else if (data = dns_find (target, &length, A_RECORD))
+  if (rr = dns_find (target, &length, AAAA_RECORD))
+    host_aaaa (s->host, rr, length);
+  if (data = dns_find (target, &length, A_RECORD))
     host_a (s->host, data, length);
-  s->srv_found = 1; return data;
+  s->srv_found = 1; return rr? rr : data;
 }
 
 // process PTR resource record
@@ -282,6 +287,10 @@ void process_answers (char *data, int count) {
 
 // process a DNS-SD packet
 void dnssd_packet (char *data, int length) { DnsHeader header;
+  // most multicast traffic is queries, discard them and responses without
+  // answers from the raw header before any names are parsed
+  if (length < 12 || (data[2] & 0xf8) != 0x80 || data[3] & 0x0f
+      || !(data[6] | data[7])) return;
   dns_start = data; dns_end = data + length; // set the boundry
   // flags should indicate a standard response with no errors
   if ((data = dns_header (&header, data))
@@ -333,7 +342,7 @@ void dnssd_followup (UdpPort *p) {
 // receive and process DNS-SD packets, return list of services
 Service *dnssd_receive (UdpPort *port) {
   char *data; int length;
-  while (data = net_receive (port, &length))
+  while (data = net_receive_batch (port, &length))
     dnssd_packet (data, length);
   dnssd_followup (port); return dns_service;
 }
@@ -3,7 +3,12 @@
 
 /** @defgroup event_queue Event Queue
 
-    Provides a timed event queue.
+    Provides a timed event queue. Events are ordered by deadlines of the
+    monotonic clock in nanoseconds, events with times given in seconds
+    (IEEE 2030.5 time, see @ref se_time) are converted to deadlines and
+    converted again if the time is set. The queue timer is armed only when the
+    earliest deadline changes, and events due within the same timer tick
+    (1 ms) are returned together after a single wakeup.
     @{
 */
 
@@ -15,10 +20,31 @@
 /** @brief Insert an event into the queue.
     @param data is a pointer to the event data
     @param type is the type of the event
-    @param time is the time at which the event becomes active
+    @param time is the time in seconds (see @ref se_time) at which the event
+    becomes active, or 0 for an event that is active immediately
 */
 void insert_event (void *data, int type, int64_t time);
 
+/** @brief Insert an event into the queue with a monotonic deadline.
+    @param data is a pointer to the event data
+    @param type is the type of the event
+    @param deadline is the time of @ref event_clock in nanoseconds at which
+    the event becomes active
+*/
+void insert_event_at (void *data, int type, int64_t deadline);
+
+/** @brief Insert an event into the queue that becomes active after a delay.
+    @param data is a pointer to the event data
+    @param type is the type of the event
+    @param ms is the delay in milliseconds
+*/
+void insert_event_ms (void *data, int type, int64_t ms);
+
+/** @brief Get the time of the monotonic clock used for event deadlines.
+    @returns the time in nanoseconds
+*/
+int64_t event_clock ();
+
 /** @brief Remove all events from the queue that match the event data.
     @brief data is a pointer to the event data
 */
@@ -39,28 +65,73 @@ void event_init ();
 typedef struct _Event {
   struct _Event *next;
   void *data; int type;
-  int64_t time;
+  int64_t time; // time in seconds, 0 for a monotonic deadline
+  int64_t deadline; // monotonic clock time in nanoseconds
 } Event;
 
+#define EVENT_TICK 1000000 // timer resolution in nanoseconds
+#define tick(t) (((t) + EVENT_TICK - 1) / EVENT_TICK)
+
 Event *cur_event = NULL;
 Queue im_event = {0};
+int64_t ev_armed = 0; // tick the timer is armed for, 0 if unarmed
+int ev_offset = 0; // se_time_offset used to convert times to deadlines
+
+int64_t event_clock () { struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int64_t time_deadline (int64_t time) {
+  return event_clock () + time * 1000000000LL - se_time_ns ();
+}
 
+// events with the same deadline are kept in the order inserted
 int event_compare (void *a, void *b) {
-  Event *x = a, *y = b; return x->time - y->time;
+  Event *x = a, *y = b; return x->deadline < y->deadline? -1 : 1;
 }
 
 void print_events () {
   Event *e = cur_event;
   printf ("print_events %d: ", list_length (e));
-  while (e) { printf ("%p %d %d, ", e->data, e->type, e->time); e = e->next; }
-  printf ("\n");
+  while (e) {
+    printf ("%p %d %ld, ", e->data, e->type, (long)e->deadline);
+    e = e->next;
+  } printf ("\n");
 }
 
-void insert_event (void *data, int type, int64_t time) {
+Event *new_event (void *data, int type, int64_t time) {
   Event *e = type_alloc (Event);
   e->data = data; e->type = type; e->time = time;
+  return e;
+}
+
+void queue_event (Event *e) {
+  cur_event = insert_sorted (cur_event, e, event_compare);
+}
+
+void insert_event (void *data, int type, int64_t time) {
+  Event *e = new_event (data, type, time);
   if (time == 0) queue_add (&im_event, e);
-  else cur_event = insert_sorted (cur_event, e, event_compare);
+  else { e->deadline = time_deadline (time); queue_event (e); }
+}
+
+void insert_event_at (void *data, int type, int64_t deadline) {
+  Event *e = new_event (data, type, 0);
+  e->deadline = deadline; queue_event (e);
+}
+
+void insert_event_ms (void *data, int type, int64_t ms) {
+  insert_event_at (data, type, event_clock () + ms * 1000000);
+}
+
+// convert the times to deadlines again after the time has been set
+void retime_events () { Event *e = cur_event, *next;
+  cur_event = NULL; ev_offset = se_time_offset;
+  while (e) { next = e->next;
+    if (e->time) e->deadline = time_deadline (e->time);
+    queue_event (e); e = next;
+  }
 }
 
 void *remove_by_data (void *list, void *data) {
@@ -82,26 +153,38 @@ void remove_event (void *data) {
 
 Timer *ev_timer;
 
-int next_event (void **any) {
+int pop_event (void **any) {
   Event *e; int event;
   if (queue_peek (&im_event)) {
     e = queue_remove (&im_event);
     event = e->type; *any = e->data;
     free (e); return event;
   }
-  if (e = cur_event) {
-    int64_t now = se_time ();
-    //printf ("next_event %d %d\n", e->time, now);
-    if (e->time <= now) {
-      event = e->type;
-      cur_event = e->next;
-      *any = e->data; free (e);
-      return event;
-    } set_timer (ev_timer, e->time - now);
-  } else set_timer (ev_timer, 0);
+  if (ev_offset != se_time_offset) retime_events ();
+  while (e = cur_event) {
+    if (tick (e->deadline) > event_clock () / EVENT_TICK) {
+      // arm the timer only if the earliest deadline has changed
+      if (tick (e->deadline) != ev_armed)
+	set_timer_at (ev_timer, ev_armed = tick (e->deadline));
+      return EVENT_NONE;
+    } cur_event = e->next;
+    if (e->time && se_time_ns () < e->time * 1000000000LL) {
+      // the system clock has drifted from the monotonic clock
+      e->deadline = time_deadline (e->time); queue_event (e); continue;
+    } event = e->type; *any = e->data;
+    free (e); return event;
+  }
+  if (ev_armed) { set_timer (ev_timer, 0); ev_armed = 0; }
   return EVENT_NONE;
 }
 
+// record the depth of the queue and the time taken to handle events
+int next_event (void **any) { LoopStats *s = event_stats (); int event;
+  if (!s) return pop_event (any);
+  event_mark (EVENT_NONE); depth_sample (&s->queued, &im_event);
+  event_mark (event = pop_event (any)); return event;
+}
+
 void event_init () {
   ev_timer = add_timer (EVENT_TIMER);
 }
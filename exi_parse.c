@@ -257,7 +257,8 @@ const ParserDriver exi_parser = {
 
 void exi_parse_init (Parser *p, const Schema *schema,
 		     char *data, int length) {
-  memset (p, 0, sizeof (Parser));
+  struct _XmlParser *xml = p->xml; // kept for reuse by parse_init
+  memset (p, 0, sizeof (Parser)); p->xml = xml;
   exi_rebuffer (p, data, length);
   p->schema = schema; p->driver = &exi_parser;
   p->global = new_string_table (NULL, NULL, 32);
@@ -20,6 +20,8 @@
 
 typedef struct _HttpConnection HttpConnection;
 
+#define HTTP_TIMEOUT (EVENT_NEW+14)
+
 enum HttpMethod {HTTP_GET, HTTP_PUT, HTTP_POST, HTTP_DELETE, HTTP_HEAD,
 		 HTTP_UNKNOWN, HTTP_RESPONSE, HTTP_NONE, HTTP_ERROR};
 
@@ -27,6 +29,7 @@ enum HttpMethod {HTTP_GET, HTTP_PUT, HTTP_POST, HTTP_DELETE, HTTP_HEAD,
 typedef struct _HttpRequest {
   struct _HttpRequest *next;
   void *context;
+  uint64_t deadline; // time a response is due (ms, monotonic), 0 for none
   uint8_t method; char uri[];
 } HttpRequest;
 
@@ -52,6 +55,9 @@ typedef struct _HttpRequest {
 void http_init (void *conn, int client, const char *accept, const char *media);
 
 /** @brief Flush queued data to an HTTP connection.
+
+    Call when the connection becomes writable (TCP_WRITABLE) to send data
+    that was queued because a write would have blocked.
     @param conn is a pointer to an HttpConnection
 */
 void http_flush (void *conn);
@@ -66,13 +72,119 @@ void http_flush (void *conn);
 */
 void http_write (void *conn, void *data, int length);
 
+/** @brief Write a vector of buffers to an HTTP connection immediately if
+    possible or queue for later.
+
+    The buffers are written in order without being concatenated. Data that
+    cannot be written immediately is queued, buffers marked as owned are
+    queued by reference and freed once they are written, other buffers are
+    copied.
+    @param conn is a pointer to an HttpConnection
+    @param iov is an array of buffers
+    @param n is the number of buffers
+    @param owned is a bit mask, bit i is set if iov[i].iov_base was
+    allocated with malloc and is passed to the HttpConnection to free
+*/
+void http_writev (void *conn, const struct iovec *iov, int n, int owned);
+
+/** @brief Set the pipelining window of an HTTP client connection.
+
+    At most window requests are sent without a response. GET and DELETE
+    requests beyond the window, or made before the connection is established,
+    wait in order and are sent as responses arrive. PUT and POST requests
+    are sent immediately. New connections use a window of 4 requests.
+    @param conn is a pointer to an HttpConnection
+    @param window is the maximum number of requests in flight, 0 for no limit
+*/
+void http_window (void *conn, int window);
+
+/** @brief Get the number of outstanding requests on an HTTP client
+    connection.
+
+    Counts the requests in flight and the requests waiting for the
+    pipelining window.
+    @param conn is a pointer to an HttpConnection
+    @returns the number of requests without a response
+*/
+int http_outstanding (void *conn);
+
+/** @brief Set the deadline for requests made on an HTTP client connection.
+
+    A response is due within ms milliseconds of the request being made,
+    including any time spent waiting for the pipelining window. When a request
+    passes its deadline event_poll returns HTTP_TIMEOUT with the connection,
+    use @ref http_expired to get the requests. New connections use the
+    deadline set with @ref http_default_deadline.
+    @param conn is a pointer to an HttpConnection
+    @param ms is the deadline in milliseconds, 0 for no deadline
+*/
+void http_deadline (void *conn, int ms);
+
+/** @brief Set the request deadline for new HTTP client connections.
+    @param ms is the deadline in milliseconds, 0 (the default) for no deadline
+*/
+void http_default_deadline (int ms);
+
+/** @brief Get the requests that have passed their deadline.
+
+    Requests waiting for the pipelining window are removed from the
+    connection. Requests in flight remain, so that a late response is received
+    in order, but they lose their context (@ref http_context returns NULL for
+    the late response) and are reported once. The list returned holds the
+    waiting requests and copies of the requests in flight, with their
+    contexts, for the caller to retry (or free with free_list).
+    @param conn is a pointer to an HttpConnection
+    @returns an HttpRequest linked list of expired requests
+*/
+HttpRequest *http_expired (void *conn);
+
+/** @brief A token bucket that limits the rate of requests to a server. */
+typedef struct _HttpLimit HttpLimit;
+
+/** @brief Create a request rate limit.
+
+    Connections that share a limit send at most rate requests per second on
+    average, with bursts of up to burst requests.
+    @param rate is the number of requests per second
+    @param burst is the maximum number of requests sent at once
+    @returns a pointer to an HttpLimit
+*/
+HttpLimit *http_limit_new (double rate, int burst);
+
+/** @brief Apply a rate limit to the requests made on an HTTP client
+    connection.
+
+    GET and DELETE requests wait for a token from the limit, when none is
+    available event_poll returns TCP_WRITABLE with the connection once a
+    request can be sent (handled with @ref http_flush). Other requests are
+    sent immediately but still take a token. A 429 or 503 response with a
+    Retry-After header holds the requests on every connection that shares
+    the limit for the time given.
+    @param conn is a pointer to an HttpConnection
+    @param limit is a pointer to an HttpLimit, NULL for no limit
+*/
+void http_limit (void *conn, HttpLimit *limit);
+
+/** @brief Get the Retry-After header value of a response.
+    @param conn is a pointer to an HttpConnection
+    @returns the delay in seconds (an HTTP-date is converted to a delay from
+    now), -1 if the response has no Retry-After header
+*/
+int http_retry_after (void *conn);
+
 /** @brief Perform a GET request immediately if possible or queue for later.
+
+    The request is sent when the pipelining window allows (see
+    @ref http_window).
     @param conn is a pointer to an HttpConnection
     @param uri is the request URI
 */
 void http_get (void *conn, const char *uri);
 
 /** @brief Perform a DELETE request immediately if possible or queue for later.
+
+    The request is sent when the pipelining window allows (see
+    @ref http_window).
     @param conn is a pointer to an HttpConnection
     @param uri is the request URI
 */
@@ -92,6 +204,19 @@ void http_delete (void *conn, const char *uri);
 */
 int http_send (void *conn, char *buffer, const char *uri, int method);
 
+/** @brief Write a PUT or POST request message with a chunked body to a
+    buffer and queue the request.
+
+    Use the function @ref http_write to send the request header, then send
+    the content with @ref http_chunk.
+    @param conn is a pointer to an HttpConnection
+    @param buffer is a buffer large enough for the request
+    @param uri is the request URI
+    @param method is either HTTP_PUT or HTTP_POST
+    @returns the length of the message
+*/
+int http_send_chunked (void *conn, char *buffer, const char *uri, int method);
+
 /** @brief Write an HTTP status line to buffer.
     @param buffer is the storage for the status line
     @param status is the status code
@@ -108,6 +233,26 @@ int http_status_line (char *buffer, int status, const char *reason);
 */
 int http_content (char *buffer, const char *media, int length);
 
+/** @brief Write HTTP content headers for a chunked message body to a
+    buffer.
+
+    The body is sent with @ref http_chunk, its length need not be known in
+    advance.
+    @param buffer is the storage for the headers
+    @param media is the Content-Type
+    @returns the length of the headers
+*/
+int http_chunked (char *buffer, const char *media);
+
+/** @brief Write a chunk of a message body with chunked transfer coding.
+
+    A chunk with length 0 ends the message body.
+    @param conn is a pointer to an HttpConnection
+    @param data is the chunk data
+    @param length is the length of the chunk
+*/
+void http_chunk (void *conn, const char *data, int length);
+
 /** @brief Update the Content-Length header.
 
     The Content-Length header should have a enough blank spaces for the length.
@@ -123,6 +268,16 @@ void set_content_length (char *buffer, int length);
 */
 HttpRequest *http_queued (void *conn);
 
+/** @brief Close the HTTP connection and keep GET requests to replay.
+
+    GET requests in flight or waiting are kept in order and sent again when
+    the connection is re-established (see @ref conn_connect), other requests
+    are returned to the caller as with @ref http_queued.
+    @param conn is a pointer to an HttpConnection
+    @returns an HttpRequest linked list of the requests not replayed
+*/
+HttpRequest *http_replay (void *conn);
+
 /** @brief Close the HTTP connection and free queued requests/data.
     @param conn is a pointer to an HttpConnection
 */
@@ -184,22 +339,40 @@ int http_body (void *conn);
 
     Call again until all the data has been returned. @ref http_complete
 
+    A body with chunked transfer coding is decoded in the receive buffer, the
+    data returned is contiguous across chunks.
+
+    Data is read from the connection until the buffer is full or no more
+    data is available.
     @param conn is a pointer to an HttpConnection
     @param length is a pointer to the length of the data returned
-    @returns a pointer to the data from the message body
+    @returns a pointer to the data from the message body, or NULL if no new
+    data is available
 */
 char *http_data (void *conn, int *length);
 
-/** @brief Clear data up to the pointer and read more data from the connection.
+/** @brief Clear data up to the pointer so more data can be read.
 
-    An HttpConnection uses a fixed length buffer to retrieve data, this
-    function clears data and moves the remainder of the data to the beginning
-    of the buffer so more data can be read.
+    The data is not moved until the space is needed to read more data. If no
+    data is cleared and the buffer is full (the unparsed data is larger than
+    the buffer) the buffer is grown, up to the maximum set by
+    @ref http_buffer_size.
     @param conn is a pointer to an HttpConnection
-    @param data is a pointer to 
+    @param data is a pointer to the unparsed data
 */
 void http_rebuffer (void *conn, char *data);
 
+/** @brief Set the receive buffer size for HttpConnections.
+
+    A receive buffer of the initial size is borrowed from a per thread pool
+    when a message starts and returned when the connection is idle. The
+    buffer grows as needed to hold a header line or unparsed data larger than
+    the buffer.
+    @param size is the initial size of the buffer in bytes
+    @param max is the maximum size of the buffer in bytes
+*/
+void http_buffer_size (int size, int max);
+
 /** @brief Is data from the message body complete?
     @param conn is a pointer to an HttpConnection
     @returns 1 is message is complete, 0 otherwise
@@ -297,21 +470,34 @@ const char * const http_methods[] =
 
 typedef struct _SendQueueItem {
   struct _SendQueueItem *next;
-  int length;
+  char *data; // either buffer or owned data
+  int length, sent, owned;
   char buffer[];
 } SendQueueItem;
 
-// An HTTP connection uses a fixed length buffer
-// make sure buffer is large enough for the request/status + headers
-#define BUFFER_SIZE 2048
+// An HTTP connection uses a receive buffer that grows as needed
+int _http_buffer = 2048, _http_buffer_max = 65536;
+
+// The number of requests pipelined on a new client connection
+int _http_window = 4;
+
+// The deadline (ms) for responses to requests on a new client connection
+int _http_deadline = 0;
+
+/* Receive buffers and request targets are borrowed from the pools while a
+   message is in flight and returned when the connection is idle */
+__thread Pool http_buffers, http_targets = {NULL, sizeof (Uri256)};
+
 typedef struct _HttpConnection {
   Connection tcp;
   char *query, *content_type, *media_range, *location;
-  Address host; // host from the Host: header field
   char *headers, *version;
   const char *media; // media type for POST/PUT
   const char *accept; // media types accepted
+  char *template; // request line version, Host and Accept header lines
+  int template_line, template_length; // request line part, total length
   char *data; // pointer to the next header line or http content
+  char *message; // start of the message, kept while parsing the headers
   int end;    // buffer + end = the end of the http message
   int length; // the amount of data in buffer
   int content_length; // from the Content-Length header
@@ -320,14 +506,31 @@ typedef struct _HttpConnection {
   unsigned close : 1; // close signaled in last request/response
   unsigned client : 1; // true for client connection
   unsigned debug : 1;
+  unsigned fresh : 1; // data read since http_data last returned
+  unsigned chunked : 1; // chunked transfer coding
+  uint8_t chunk; // the next part of a chunked body
   int status, error, header;
+  int retry_after; // Retry-After delay (seconds), -1 for none
   void *context; // request context
-  Queue send, request;
-  char target[256]; Uri uri; // request target
-  char buffer[BUFFER_SIZE];
+  Queue send, request; // data to send, requests in flight
+  Queue waiting; // requests held back by the pipelining window
+  HttpRequest *last; // the last request made
+  int window, in_flight; // maximum and number of requests in flight
+  int deadline; uint64_t due; // request deadline (ms), earliest deadline
+  Timer timer; // expires at the earliest deadline (HTTP_TIMEOUT)
+  HttpLimit *limit; // request rate limit shared with other connections
+  Timer resume; // expires when the limit allows a request (TCP_WRITABLE)
+  Uri256 *target; // request target and host from the Host: header field
+  char *buffer; int size; // receive buffer
 } HttpConnection;
 
-#define buffer_full(h) (((h)->length+1) == BUFFER_SIZE)
+#define buffer_full(h) (((h)->length+1) == (h)->size)
+
+typedef struct _HttpLimit {
+  double rate, tokens; // requests per second, tokens in the bucket
+  int burst; // bucket size
+  uint64_t time, hold; // last refill, requests held until (ms, monotonic)
+} HttpLimit;
 
 #include "http_parse.c"
 
@@ -338,17 +541,22 @@ int http_content_length (void *conn) {
   return http_field (conn, content_length); }
 int http_status (void *conn) { return http_field (conn, status); }
 int http_method (void *conn) { return http_field (conn, request_method); }
-char *http_path (void *conn) { return http_field (conn, uri.path); }
-char *http_query (void *conn) { return http_field (conn, uri.query); }
+char *http_path (void *conn) { HttpConnection *c = conn;
+  return c->target? c->target->uri.path : NULL;
+}
+char *http_query (void *conn) { HttpConnection *c = conn;
+  return c->target? c->target->uri.query : NULL;
+}
 char *http_range (void *conn) { return http_field (conn, media_range); }
 int http_client (void *conn) { return http_field (conn, client); }
 char *http_location (void *conn) { return http_field (conn, location); }
 void http_debug (void *conn, int enable) { http_field (conn, debug) = enable; }
 void *http_context (void *conn) { return http_field (conn, context); }
+int http_retry_after (void *conn) { return http_field (conn, retry_after); }
 
 void print_http_status (void *conn) { HttpConnection *c = conn;
   const char *method = http_methods[c->request_method];
-  printf ("%s %s: %d\n", method, c->uri.path, c->status);  
+  printf ("%s %s: %d\n", method, http_path (c), c->status);  
 }
 
 void http_init (void *conn, int client,
@@ -356,92 +564,278 @@ void http_init (void *conn, int client,
 		const char *media) {
   HttpConnection *c = conn;
   c->client = client;
-  c->data = c->buffer;
   c->accept = accept;
   c->media = media;
   c->version = "HTTP/1.1";
   c->headers = "";
+  c->window = _http_window; c->deadline = _http_deadline;
+  timer_init (&c->timer, HTTP_TIMEOUT, c);
+  timer_init (&c->resume, TCP_WRITABLE, c);
 }
 
-void print_headers (void *conn, char *buffer) { char *end;
-  if (end = strstr (buffer, "\r\n\r\n")) { *end = '\0';
-    printf ("--- conn = %p -->\n"
-	    "%s\r\n\r\n", conn, buffer); *end = '\r';
+void http_window (void *conn, int window) {
+  http_field (conn, window) = window;
+}
+
+int http_outstanding (void *conn) { HttpConnection *c = conn;
+  return c->in_flight + list_length (c->waiting.first);
+}
+
+void http_deadline (void *conn, int ms) {
+  http_field (conn, deadline) = ms;
+}
+
+void http_default_deadline (int ms) { _http_deadline = ms; }
+
+HttpLimit *http_limit_new (double rate, int burst) {
+  HttpLimit *l = type_alloc (HttpLimit);
+  l->rate = rate; l->tokens = l->burst = max (burst, 1);
+  l->time = clock_ms (); return l;
+}
+
+void http_limit (void *conn, HttpLimit *limit) {
+  http_field (conn, limit) = limit;
+}
+
+// add the tokens accrued since the last refill
+void limit_refill (HttpLimit *l, uint64_t now) {
+  if (now > l->time) {
+    l->tokens = min (l->burst, l->tokens + (now - l->time) * l->rate / 1000);
+    l->time = now;
   }
 }
 
+// take a token, returns 0 or the time (ms) when a token is available
+uint64_t limit_take (HttpLimit *l, uint64_t now) {
+  if (now < l->hold) return l->hold;
+  limit_refill (l, now);
+  if (l->tokens < 1) return now + (1 - l->tokens) * 1000 / l->rate + 1;
+  l->tokens--; return 0;
+}
+
+void print_headers (void *conn, const char *data, int length) { int n = 0;
+  while (n + 3 < length && memcmp (data+n, "\r\n\r\n", 4)) n++;
+  if (n + 3 < length)
+    printf ("--- conn = %p -->\n"
+	    "%.*s\r\n\r\n", conn, n, data);
+}
+
+void send_item_free (SendQueueItem *i) {
+  if (i->owned) free (i->data); free (i);
+}
+
+void send_queue_free (Queue *q) { SendQueueItem *i;
+  while (i = queue_remove (q)) send_item_free (i);
+}
+
+#define SEND_IOV 16 // maximum number of queued items in a write
+
+void send_waiting (HttpConnection *c);
+
 void http_flush (void *conn) {
   HttpConnection *h = conn; SendQueueItem *i;
-  while ((i = queue_peek (&h->send))
-	 && conn_write (conn, i->buffer, i->length) > 0) {
-    if (h->debug) print_headers (conn, i->buffer);
-    free (queue_remove (&h->send));
+  struct iovec iov[SEND_IOV]; int n, k, length, partial;
+  send_waiting (h);
+  while (i = queue_peek (&h->send)) {
+    for (n = length = 0; i && n < SEND_IOV; i = i->next, n++) {
+      iov[n].iov_base = i->data + i->sent;
+      length += iov[n].iov_len = i->length - i->sent;
+    }
+    if ((k = conn_writev (conn, iov, n)) <= 0) break;
+    partial = k < length;
+    while ((i = queue_peek (&h->send)) && k >= i->length - i->sent) {
+      k -= i->length - i->sent; send_item_free (queue_remove (&h->send));
+    }
+    if (i) i->sent += k;
+    if (partial) break;
   }
   if (queue_empty (&h->send) && h->close) conn_close (h);
 }
 
+void send_queue_add (HttpConnection *h, const struct iovec *v,
+		     int sent, int owned) {
+  int length = v->iov_len; SendQueueItem *i;
+  if (owned) { // queue by reference
+    i = malloc (sizeof (SendQueueItem)); i->data = v->iov_base;
+  } else { // copy the data not yet written
+    i = malloc (sizeof (SendQueueItem) + length - sent);
+    memcpy (i->data = i->buffer, (char *)v->iov_base + sent, length - sent);
+    length -= sent; sent = 0;
+  }
+  i->length = length; i->sent = sent; i->owned = owned;
+  i->next = NULL; queue_add (&h->send, i);
+}
+
+void http_writev (void *conn, const struct iovec *iov, int n, int owned) {
+  HttpConnection *h = conn; int i, k = 0, length;
+  if (h->debug) print_headers (conn, iov[0].iov_base, iov[0].iov_len);
+  if (!h->send.first && (k = conn_writev (conn, iov, n)) < 0) k = 0;
+  for (i = 0; i < n; i++) {
+    length = iov[i].iov_len;
+    if (k < length) {
+      send_queue_add (h, &iov[i], k, owned & 1 << i); k = 0;
+    } else {
+      if (owned & 1 << i) free (iov[i].iov_base);
+      k -= length;
+    }
+  }
+}
+
 void http_write (void *conn, void *data, int length) {
-  HttpConnection *h = conn;
-  if (h->send.first || conn_write (conn, data, length) < 0) {
-    SendQueueItem *i = malloc (sizeof (SendQueueItem) + length);
-    i->length = length; i->next = NULL;
-    memcpy (i->buffer, data, length);
-    queue_add (&h->send, i); return;
-  } if (h->debug) print_headers (conn, data);
+  struct iovec iov = {data, length};
+  http_writev (conn, &iov, 1, 0);
 }
 
-void queue_request (HttpConnection *c, int method, const char *uri) {
+/* The timer is armed for the earliest deadline of the requests in flight or
+   waiting, it is only re-armed when that request leaves the queues */
+void set_due (HttpConnection *c, uint64_t t) {
+  if (t && (!c->due || t < c->due)) {
+    c->due = t; set_timer_at (&c->timer, t);
+  }
+}
+
+void http_due (HttpConnection *c) { HttpRequest *r; uint64_t t = 0;
+  foreach (r, c->request.first)
+    if (r->deadline && (!t || r->deadline < t)) t = r->deadline;
+  foreach (r, c->waiting.first)
+    if (r->deadline && (!t || r->deadline < t)) t = r->deadline;
+  if (t != c->due) {
+    if (c->due = t) set_timer_at (&c->timer, t);
+    else set_timer_ms (&c->timer, 0);
+  }
+}
+
+HttpRequest *new_request (HttpConnection *c, int method, const char *uri) {
   HttpRequest *r = malloc (sizeof (HttpRequest) + strlen (uri) + 1);
   r->next = r->context = NULL; r->method = method; strcpy (r->uri, uri);
-  queue_add (&c->request, r);
+  r->deadline = c->deadline? clock_ms () + c->deadline : 0;
+  set_due (c, r->deadline); return c->last = r;
+}
+
+void queue_request (HttpConnection *c, int method, const char *uri) {
+  queue_add (&c->request, new_request (c, method, uri)); c->in_flight++;
+  if (c->limit) { // sent without waiting, the token may be borrowed
+    limit_refill (c->limit, clock_ms ()); c->limit->tokens--;
+  }
 }
 
 void set_request_context (void *conn, void *context) {
-  HttpConnection *c = conn; HttpRequest *r;
-  if (r = queue_tail (&c->request)) r->context = context;
+  HttpConnection *c = conn;
+  if (c->last) c->last->context = context;
 }
 
 HttpRequest *dequeue_request (HttpConnection *c) {
-  return queue_remove (&c->request);
+  HttpRequest *r = queue_remove (&c->request);
+  if (r) {
+    if (r == c->last) c->last = NULL;
+    if (r->deadline && r->deadline == c->due) http_due (c);
+    c->in_flight--; send_waiting (c);
+  } return r;
 }
 
-int http_date (char *buffer) {
-  time_t now = time (NULL); struct tm tm = *gmtime (&now);
-  return strftime (buffer, 1024, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+/* The Date header line is formatted at most once a second per thread */
+__thread time_t _date_time; __thread int _date_length;
+__thread char _date[64];
+
+int http_date (char *buffer) { time_t now = time (NULL); struct tm tm;
+  if (now != _date_time) {
+    gmtime_r (&now, &tm); _date_time = now;
+    _date_length = strftime (_date, sizeof (_date),
+			     "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+  }
+  memcpy (buffer, _date, _date_length); return _date_length;
 }
 
-int http_request (void *conn, char *buffer, const char *uri, int method) {
-  HttpConnection *c = conn; Address addr;
+// render the parts of a request that are fixed for the connection
+void http_template (HttpConnection *c) { Address addr; char host[64];
+  int n = write_address_port (host, net_remote (&addr, c));
+  c->template = malloc (n + strlen (c->version) + strlen (c->accept) + 24);
+  c->template_line = sprintf (c->template, " %s\r\n", c->version);
+  c->template_length = c->template_line
+    + sprintf (c->template + c->template_line, "Host: %s\r\nAccept: %s\r\n",
+	       host, c->accept);
+}
+
+int request_header (HttpConnection *c, char *buffer, const char *uri,
+		    int method) {
   const char *name = http_methods[method];
-  int n = sprintf (buffer, "%s %s %s\r\n", name, uri, c->version);
-  n += http_date (buffer+n); n += sprintf (buffer+n, "Host: ");
-  n += write_address_port (buffer+n, net_remote (&addr, c));
-  n += sprintf (buffer+n, "\r\nAccept: %s\r\n", c->accept);
+  int n = strlen (name), k = strlen (uri);
+  if (!c->template) http_template (c);
+  memcpy (buffer, name, n); buffer[n++] = ' ';
+  memcpy (buffer+n, uri, k); n += k;
+  memcpy (buffer+n, c->template, c->template_line); n += c->template_line;
+  n += http_date (buffer+n); k = c->template_length - c->template_line;
+  memcpy (buffer+n, c->template + c->template_line, k + 1);
+  // the remote address is only known once the connection is established
+  if (net_status (c) != Connected) { free (c->template); c->template = NULL; }
+  return n + k;
+}
+
+int http_request (void *conn, char *buffer, const char *uri, int method) {
+  int n = request_header (conn, buffer, uri, method);
   queue_request (conn, method, uri); return n;
 }
 
-void http_get (void *conn, const char *uri) { char buffer[256];
-  int n = http_request (conn, buffer, uri, HTTP_GET);
-  n += sprintf (buffer+n, "\r\n");
-  http_write (conn, buffer, n);
+// send waiting requests while the window and limit allow, in a single write
+void send_waiting (HttpConnection *c) { HttpRequest *r; char buffer[2048];
+  int n = 0, k; uint64_t t, now = c->limit? clock_ms () : 0;
+  if (net_status (c) != Connected) return;
+  while ((!c->window || c->in_flight < c->window)
+	 && (r = queue_peek (&c->waiting))) {
+    if (c->limit && (t = limit_take (c->limit, now))) {
+      set_timer_at (&c->resume, t); break;
+    }
+    k = strlen (r->uri) + strlen (c->accept) + 128; // request size bound
+    if (n && n + k > sizeof (buffer)) { http_write (c, buffer, n); n = 0; }
+    n += request_header (c, buffer+n, r->uri, r->method);
+    n += sprintf (buffer+n, "\r\n");
+    queue_remove (&c->waiting);
+    r->next = NULL; queue_add (&c->request, r); c->in_flight++;
+  }
+  if (n) http_write (c, buffer, n);
 }
 
-void http_delete (void *conn, const char *uri) { char buffer[256];
-  int n = http_request (conn, buffer, uri, HTTP_DELETE);
-  n += sprintf (buffer+n, "\r\n");
-  http_write (conn, buffer, n);
+void http_get (void *conn, const char *uri) { HttpConnection *c = conn;
+  queue_add (&c->waiting, new_request (c, HTTP_GET, uri)); send_waiting (c);
+}
+
+void http_delete (void *conn, const char *uri) { HttpConnection *c = conn;
+  queue_add (&c->waiting, new_request (c, HTTP_DELETE, uri));
+  send_waiting (c);
 }
 
 int http_content (char *buffer, const char *media, int length) {
   int n = sprintf (buffer, "Content-Type: %s\r\n", media);
-  n += sprintf (buffer+n, "Content-Length: %-6d\r\n\r\n", length);
+  n += sprintf (buffer+n, "Content-Length: %d\r\n\r\n", length);
   return n;
 }
 
 int http_send (void *conn, char *buffer, const char *uri, int method) {
   HttpConnection *c = conn;
   int n = http_request (conn, buffer, uri, method);
-  return n + http_content (buffer+n, c->media, 0);
+  // blank spaces for the length (see set_content_length)
+  return n + sprintf (buffer+n, "Content-Type: %s\r\n"
+		      "Content-Length: %-6d\r\n\r\n", c->media, 0);
+}
+
+int http_chunked (char *buffer, const char *media) {
+  return sprintf (buffer, "Content-Type: %s\r\n"
+		  "Transfer-Encoding: chunked\r\n\r\n", media);
+}
+
+int http_send_chunked (void *conn, char *buffer, const char *uri,
+		       int method) {
+  HttpConnection *c = conn;
+  int n = http_request (conn, buffer, uri, method);
+  return n + http_chunked (buffer+n, c->media);
+}
+
+void http_chunk (void *conn, const char *data, int length) {
+  char size[16]; struct iovec iov[3] = {{size}, {(void *)data, length},
+					{"\r\n", 2}};
+  if (!length) { http_write (conn, "0\r\n\r\n", 5); return; }
+  iov[0].iov_len = sprintf (size, "%x\r\n", length);
+  http_writev (conn, iov, 3, 0);
 }
 
 void set_content_length (char *buffer, int length) {
@@ -449,14 +843,65 @@ void set_content_length (char *buffer, int length) {
   field += sprintf (field, "%d", length); *field = ' ';
 }
 
+// borrow a receive buffer when a message starts
+void http_acquire (HttpConnection *h) {
+  if (http_buffers.size != _http_buffer)
+    pool_resize (&http_buffers, _http_buffer);
+  h->data = h->buffer = pool_get (&http_buffers);
+  h->size = http_buffers.size; h->length = 0; *h->data = '\0';
+}
+
+// return the receive buffer and request target, a grown buffer is freed
+void http_release (HttpConnection *h) {
+  if (h->buffer) {
+    if (h->size == http_buffers.size) pool_put (&http_buffers, h->buffer);
+    else free (h->buffer);
+    h->data = h->buffer = NULL; h->length = 0;
+  }
+  if (h->target) { pool_put (&http_targets, h->target); h->target = NULL; }
+  h->message = h->content_type = h->media_range = h->location = NULL;
+}
+
 HttpRequest *http_queued (void *conn) {
-  HttpConnection *h = conn;
-  HttpRequest *r = queue_peek (&h->request);
-  queue_free (&h->send); queue_clear (&h->request);
+  HttpConnection *h = conn; HttpRequest *r;
+  if (h->request.last) { // requests in flight followed by those waiting
+    h->request.last->next = h->waiting.first; r = queue_peek (&h->request);
+  } else r = queue_peek (&h->waiting);
+  send_queue_free (&h->send); queue_clear (&h->request);
+  queue_clear (&h->waiting); h->last = NULL; h->in_flight = 0; http_due (h);
+  set_timer_ms (&h->resume, 0);
+  http_release (h); free (h->template); h->template = NULL;
   conn_close (h); h->state = HTTP_CLOSED;
   return r;
 }
 
+HttpRequest *http_replay (void *conn) {
+  HttpConnection *h = conn; HttpRequest *r = http_queued (conn), *next;
+  Queue lost = {NULL, NULL};
+  for (; r; r = next) { next = r->next; r->next = NULL;
+    queue_add (r->method == HTTP_GET? &h->waiting : &lost, r);
+  }
+  h->state = HTTP_START; http_due (h); return queue_peek (&lost);
+}
+
+HttpRequest *http_expired (void *conn) {
+  HttpConnection *c = conn; HttpRequest *r, *next, *e;
+  Queue expired = {NULL, NULL}; uint64_t now = clock_ms (); int n;
+  foreach (r, c->request.first) // copy the requests in flight
+    if (r->deadline && r->deadline <= now) {
+      n = sizeof (HttpRequest) + strlen (r->uri) + 1;
+      e = memcpy (malloc (n), r, n); e->next = NULL; queue_add (&expired, e);
+      r->deadline = 0; r->context = NULL;
+    }
+  r = queue_peek (&c->waiting); queue_clear (&c->waiting);
+  for (; r; r = next) { next = r->next; r->next = NULL;
+    if (r->deadline && r->deadline <= now) {
+      if (r == c->last) c->last = NULL;
+      queue_add (&expired, r);
+    } else queue_add (&c->waiting, r);
+  } http_due (c); return queue_peek (&expired);
+}
+
 void http_close (void *conn) {
   printf ("http_close\n");
   free_list (http_queued (conn));
@@ -481,12 +926,14 @@ void http_no_content (void *conn, const char *uri) { char buffer[512];
 
 void http_allow (void *conn, const char *allow) { char buffer[512];
   int n = http_status_line (buffer, 405, "Method Not Allowed");
-  n += sprintf (buffer+n, "Allow: %s\r\n\r\n", allow);
+  n += sprintf (buffer+n, "Allow: %s\r\nContent-Length: 0\r\n\r\n", allow);
   http_write (conn, buffer, n);
 }
 
 const char *http_reason (int status) {
   switch (status) {
+  case 200: return "OK";
+  case 201: return "Created";
   case 204: return "No Content";
   case 400: return "Bad Request";
   case 403: return "Forbidden";
@@ -495,7 +942,10 @@ const char *http_reason (int status) {
   case 408: return "Request Timeout";
   case 406: return "Not Acceptable";
   case 415: return "Unsupported Media Type";
+  case 429: return "Too Many Requests";
+  case 431: return "Request Header Fields Too Large";
   case 500: return "Internal Server Error";
+  case 503: return "Service Unavailable";
   default: return "";
   }
 }
@@ -513,58 +963,149 @@ void http_error (void *conn, int status) {
   http_respond (conn, status); http_close (conn);
 }
 
+void http_buffer_size (int size, int max) {
+  _http_buffer = size; _http_buffer_max = max;
+}
+
+#define rebase(ptr, n) if (ptr) (ptr) += (n)
+
+// adjust the pointers into the buffer after the data has moved
+void http_rebase (HttpConnection *h, long n) {
+  rebase (h->data, n); rebase (h->message, n);
+  rebase (h->content_type, n); rebase (h->media_range, n);
+  rebase (h->location, n);
+}
+
+// move the data still needed to the start of the buffer
+int http_compact (HttpConnection *h) {
+  char *keep = h->state == HTTP_HEADER? h->message : h->data;
+  int n = keep - h->buffer;
+  if (n) {
+    if (h->state > HTTP_HEADER && h->end) h->end -= n;
+    h->length -= n; http_rebase (h, -n);
+    memmove (h->buffer, keep, h->length+1);
+  } return n;
+}
+
+/* a buffer that can't grow is full, the header is then answered with 431
+   (or the client connection is closed) */
+int http_grow (HttpConnection *h) { char *buffer; int size;
+  if (h->size == _http_buffer_max) return 0;
+  size = min (h->size * 2, _http_buffer_max);
+  if (!(buffer = realloc (h->buffer, size))) return 0;
+  http_rebase (h, buffer - h->buffer);
+  h->buffer = buffer; h->size = size; return 1;
+}
+
+/* make space to read more data, a line longer than the buffer grows the
+   buffer, message data is only moved (see http_rebuffer) */
+int http_space (HttpConnection *h) {
+  return !buffer_full (h) || http_compact (h)
+    || (h->state <= HTTP_HEADER && http_grow (h));
+}
+
 int http_read (void *conn) {
-  HttpConnection *h = conn;
-  int n = conn_read (conn, h->buffer+h->length,
-		     BUFFER_SIZE-h->length-1);
+  HttpConnection *h = conn; int n;
+  if (!http_space (h)) return 0;
+  n = conn_read (conn, h->buffer+h->length, h->size-h->length-1);
   if (n <= 0) return n;
-  h->length += n;
+  h->length += n; h->fresh = 1;
   h->buffer[h->length] = '\0';
   return n;
 }
 
 int http_complete (void *conn) { HttpConnection *c = conn;
+  if (c->chunked) return c->state >= HTTP_COMPLETE;
   return c->state == HTTP_CLOSED || c->end <= c->length;
 }
 
+enum ChunkState {CHUNK_SIZE, CHUNK_DATA, CHUNK_TRAILER};
+
+/* Remove the chunked transfer coding from the receive buffer so that the
+   body data is contiguous, buffer + end is the end of the chunk data
+   received or expected. Returns 1 once the last chunk and trailer have been
+   removed, 0 if more data is needed and -1 for an invalid chunk. */
+int http_dechunk (HttpConnection *c) {
+  char *p, *line, *next; long size = 0; int n;
+  while (c->end <= c->length) {
+    line = p = c->buffer + c->end;
+    if (c->chunk == CHUNK_DATA) { // CRLF after the chunk data
+      if (c->length - c->end < 2) return 0;
+      if (memcmp (p, "\r\n", 2)) return -1;
+      line += 2;
+    }
+    if (!(next = memchr (line, '\n', c->buffer + c->length - line)))
+      return 0;
+    if (next == line || next[-1] != '\r') return -1;
+    if (c->chunk == CHUNK_TRAILER) {
+      if (next - line == 1) { // end of the trailer
+	n = next + 1 - p; c->chunk = CHUNK_SIZE;
+	memmove (p, next + 1, c->length - c->end - n + 1);
+	c->length -= n; return 1;
+      }
+    } else {
+      if (!isxdigit (*line)) return -1;
+      size = strtol (line, &line, 16);
+      if ((*line != ';' && *line != '\r') || size > INT_MAX - c->end)
+	return -1;
+      c->chunk = size? CHUNK_DATA : CHUNK_TRAILER;
+    }
+    n = next + 1 - p; // remove the line from the buffer
+    memmove (p, next + 1, c->length - c->end - n + 1);
+    c->length -= n;
+    if (c->chunk == CHUNK_DATA) c->end += size;
+  } return 0;
+}
+
 // return data associated with HTTP message
 char *http_data (void *conn, int *length) {
-  HttpConnection *c = conn;
+  HttpConnection *c = conn; int done;
   if (c->state != HTTP_DATA) return NULL;
  top:
-  if (c->close) {
+  if (c->chunked) {
+    if ((done = http_dechunk (c)) < 0) {
+      if (c->client) http_close (c); else http_error (c, 400);
+      return NULL;
+    }
+    if (done) {
+      *length = c->end; c->state++; // HTTP_COMPLETE
+      event_again (c);
+    } else if (http_read (c) > 0) goto top;
+    else if (!c->fresh) return NULL;
+    else *length = min (c->end, c->length);
+  } else if (c->close) {
     if (net_status (c) == Closed) c->state++; // HTTP_COMPLETE
     http_read (c); *length = c->length;
   } else if (c->end <= c->length) {
     *length = c->end; c->state++; // HTTP_COMPLETE
-  } else if (!buffer_full (c) && http_read (c) > 0)
+    event_again (c); // release the buffer if no more data is available
+  } else if (http_read (c) > 0)
     goto top;
+  else if (!c->fresh) return NULL; // wait for more data
   else *length = c->length;
-  *length -= c->data - c->buffer;
+  *length -= c->data - c->buffer; c->fresh = 0;
   return c->data;
 }					       
 
 void http_rebuffer (void *conn, char *data) {
-  HttpConnection *c = conn; int n;
-  if (n = data - c->buffer) {
-    if (c->end) c->end -= n;
-    c->length -= n; c->data = c->buffer;
-    memmove (c->buffer, data, c->length+1);
-  }
+  HttpConnection *c = conn;
+  if (data == c->buffer && buffer_full (c)) http_grow (c);
+  else c->data = data;
 }
 
 // return next complete line in message or NULL
 static char *next_line (HttpConnection *h) {
-  int c; char *data = h->data;
+  int i = 0; char *cr; // offset from h->data, the buffer can move when read
  top:
-  while ((c = *data)) {
-    if (c == '\r' && *(data+1) == '\n') {
-      *data = '\0';
-      return data+2;
-    }
-    data++;
-  } if (http_read (h) > 0) goto top;
-  if (data != h->data || h->state != HTTP_START)
+  while (*(cr = scan2 (h->data+i, '\r', '\r'))) {
+    i = cr - h->data;
+    if (cr[1] == '\n') {
+      *cr = '\0'; return cr+2;
+    } if (!cr[1]) break; // CR LF split between reads
+    i++;
+  } i = cr - h->data;
+  if (http_read (h) > 0) goto top;
+  if (i || h->state != HTTP_START)
     set_timeout (h);
   return NULL;
 }
@@ -576,24 +1117,29 @@ static char *next_line (HttpConnection *h) {
 #define HTTP_CONTENT_LENGTH 8
 #define HTTP_CONNECTION 16
 #define HTTP_LOCATION 32
+#define HTTP_TRANSFER_ENCODING 64
+#define HTTP_RETRY_AFTER 128
 
 // receive an HTTP message
 int http_receive (void *conn) {
   HttpConnection *c = conn; HttpRequest *r; Uri uri; int i;
-  const char * const headers[] = {"host", "accept", "content-type",
-				  "content-length", "connection",
-				  "location"}; 
   char *header, *method, *target, *text, *data, *next;
   while (1) {
     switch (c->state) {
     case HTTP_START: // request/status line
-      ok_v (next = next_line (c), HTTP_NONE); data = c->data;
+      if (!c->buffer) http_acquire (c);
+      if (!(next = next_line (c))) {
+	if (!*c->data) http_release (c); // idle
+	goto incomplete;
+      }
+      data = c->message = c->data;
       if (*data == '\0') break; // allow empty lines to start
       if (c->debug) printf ("<-- conn = %p ---\n"
 			    "%s\r\n", c, data);
       c->close = c->end = c->header = c->error = 0;
-      c->content_type = c->media_range = NULL; c->body = 1;
-      c->content_length = -1;
+      c->chunked = 0; c->chunk = CHUNK_SIZE;
+      c->content_type = c->media_range = c->location = NULL; c->body = 1;
+      c->content_length = c->retry_after = -1;
       if (c->client) {
 	if ((data = token_sp (&text, data))
 	    && streq (text, c->version) // status line
@@ -614,7 +1160,8 @@ int http_receive (void *conn) {
       } else { http_error (c, 400); return HTTP_ERROR; }
       c->state++; break;
     case HTTP_HEADER:
-      ok_v (next = next_line (c), HTTP_NONE); data = c->data;
+      if (!(next = next_line (c))) goto incomplete;
+      data = c->data;
       if (c->debug) printf ("%s\r\n", data);
       switch (*data) {
       case '\0': // end of headers
@@ -622,27 +1169,33 @@ int http_receive (void *conn) {
 	  if (c->method == HTTP_RESPONSE) goto close;
 	  http_error (c, c->error); return HTTP_ERROR;
 	}
+	// chunked transfer coding overrides the Content-Length
+	if (c->chunked) { c->end = 0; c->content_length = -1; }
+	if (c->limit && c->retry_after >= 0 // hold requests to the server
+	    && (c->status == 429 || c->status == 503))
+	  c->limit->hold = max (c->limit->hold,
+				clock_ms () + (uint64_t)c->retry_after * 1000);
 	if ((c->method == HTTP_RESPONSE
-	     && ((c->header & HTTP_CONTENT_LENGTH && !c->end)
+	     && ((c->header & HTTP_CONTENT_LENGTH && !c->end && !c->chunked)
 		 || ((c->status >= 100 && c->status <= 199)
 		     || c->status == 204 || c->status == 304)))
-	     || (c->method != HTTP_RESPONSE && !c->end)) {
+	     || (c->method != HTTP_RESPONSE && !c->end && !c->chunked)) {
 	  // response or request with no body
-	  c->body = 0; c->state = HTTP_COMPLETE;
+	  c->body = 0; c->state = HTTP_COMPLETE; event_again (c);
 	} else { c->state++; // HTTP_DATA
-	  if (!c->end) c->close = 1; // close-delimited message
+	  if (!c->end && !c->chunked) c->close = 1; // close-delimited message
 	}
 	c->end += next - c->buffer; // message end	
-	c->data = next;
+	c->data = next; c->fresh = 1;
 	return c->method;
       case ' ': case '\t': c->error = 400; break; // obsolete line folding
       default:
 	if (data = token_colon (&header, data)) {
-	  i = string_index (to_lower (header), headers, 6);
+	  i = header_index (header);
 	  c->header |= 1 << i;
 	  switch (i) {
 	  case 0: // Host
-	    data = ows (parse_host (&uri, &c->host, data));
+	    data = ows (parse_host (&uri, &c->target->host, data));
 	    if (*data != '\0') c->error = 400; break;
 	  case 1: // Accept
 	    c->media_range = data; break;
@@ -658,7 +1211,15 @@ int http_receive (void *conn) {
 	      c->close = streq (to_lower (text), "close");
 	    break;
 	  case 5: // Location
-	    c->location = data;
+	    c->location = data; break;
+	  case 6: // Transfer-Encoding, chunked must be the final coding
+	    i = strlen (to_lower (data));
+	    while (i && (data[i-1] == ' ' || data[i-1] == '\t')) i--;
+	    c->chunked = i >= 7 && !strncmp (data+i-7, "chunked", 7);
+	    if (!c->chunked && c->method != HTTP_RESPONSE) c->error = 400;
+	    break;
+	  case 7: // Retry-After, delay in seconds or an HTTP-date
+	    c->retry_after = retry_after (data);
 	  }
 	} else c->error = 400;
       } break;
@@ -673,6 +1234,11 @@ int http_receive (void *conn) {
     }
     c->data = next;
   }
+ incomplete:
+  if (!buffer_full (c)) return HTTP_NONE;
+  // a line is longer than the maximum buffer size
+  if (c->client) goto close;
+  http_error (c, 431); return HTTP_ERROR;
  close:
   http_close (c); return HTTP_NONE;
 }
@@ -1,12 +1,67 @@
 // Copyright (c) 2015 Electric Power Research Institute, Inc.
 // author: Mark Slicker <mark.slicker@gmail.com>
 
-static int tchar (int c) {
-  return in_range (c, 'A', 'Z') || in_range (c, '^', 'z') 
-    || in_range (c, '0', '9') || c == '!' || in_range (c, '#', '\'')
-    || in_range (c, '*', '+') || in_range (c, '-', '.')
-    || c == '|' || c == '~'; 
+#if defined (__AVX2__)
+#include <immintrin.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Return a pointer to the first byte in a NUL terminated string that is
+   either a or b or the terminating NUL. The vector versions use aligned
+   loads, a load never crosses a page boundary so bytes past the terminator
+   that are read are in the same page. */
+#if defined (__AVX2__)
+static char *scan2 (char *s, int a, int b) {
+  const __m256i va = _mm256_set1_epi8 (a), vb = _mm256_set1_epi8 (b),
+    z = _mm256_setzero_si256 ();
+  int off = (uintptr_t)s & 31; const __m256i *p = (__m256i *)(s - off);
+  __m256i x = _mm256_load_si256 (p); unsigned m;
+  m = (unsigned)_mm256_movemask_epi8
+    (_mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (x, va),
+				       _mm256_cmpeq_epi8 (x, vb)),
+		      _mm256_cmpeq_epi8 (x, z))) >> off;
+  if (m) return s + __builtin_ctz (m);
+  while (1) {
+    x = _mm256_load_si256 (++p);
+    m = _mm256_movemask_epi8
+      (_mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (x, va),
+					 _mm256_cmpeq_epi8 (x, vb)),
+			_mm256_cmpeq_epi8 (x, z)));
+    if (m) return (char *)p + __builtin_ctz (m);
+  }
+}
+#elif defined (__SSE2__)
+static char *scan2 (char *s, int a, int b) {
+  const __m128i va = _mm_set1_epi8 (a), vb = _mm_set1_epi8 (b),
+    z = _mm_setzero_si128 ();
+  int off = (uintptr_t)s & 15; const __m128i *p = (__m128i *)(s - off);
+  __m128i x = _mm_load_si128 (p); unsigned m;
+  m = _mm_movemask_epi8 (_mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (x, va),
+						      _mm_cmpeq_epi8 (x, vb)),
+				       _mm_cmpeq_epi8 (x, z))) >> off;
+  if (m) return s + __builtin_ctz (m);
+  while (1) {
+    x = _mm_load_si128 (++p);
+    m = _mm_movemask_epi8 (_mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (x, va),
+							_mm_cmpeq_epi8 (x, vb)),
+					 _mm_cmpeq_epi8 (x, z)));
+    if (m) return (char *)p + __builtin_ctz (m);
+  }
 }
+#else
+static char *scan2 (char *s, int a, int b) {
+  while (*s && *s != a && *s != b) s++;
+  return s;
+}
+#endif
+
+// tchar (RFC 7230 3.2.6) as a bit set
+static const uint32_t tchars[8] = {
+  0x00000000, 0x03ff6cfa, 0xc7fffffe, 0x57ffffff, 0, 0, 0, 0
+};
+
+#define tchar(c) (tchars[(uint8_t)(c) >> 5] >> ((c) & 31) & 1)
 
 static char *token (char **t, char *data) {
   *t = data; while (tchar (*data)) data++;
@@ -123,26 +178,64 @@ int http_parse_uri (void *buf, void *conn, const char *data, int length) {
 // parse HTTP request target (RFC 7230 Appendix B. Collected ABNF)
 int request_target (HttpConnection *h, char *data) {
   int c = *data, length = strlen (data);
+  Uri256 *t;
   if (length > 255) { h->error = 414; return 0; }
-  strcpy (h->target, data);
+  if (!(t = h->target)) t = h->target = pool_get (&http_targets);
+  strcpy (t->buffer, data);
   // authority form is only used for the CONNECT method (not supported)
   if (c == '/')
-    data = parse_uri (&h->uri, &h->host, 5, h->target); // origin-form
-  else data = parse_uri (&h->uri, &h->host, 0, h->target); // absolute form
+    data = parse_uri (&t->uri, &t->host, 5, t->buffer); // origin-form
+  else data = parse_uri (&t->uri, &t->host, 0, t->buffer); // absolute form
   return data != NULL;
 }
 
 static char *token_sp (char **token, char *data) {
-  int c; *token = data;
-  while ((c = *data)) {
-    if (hws (c)) { *data = '\0'; return ows (data+1); } data++;
-  } return NULL;
+  *token = data; data = scan2 (data, ' ', '\t');
+  if (!*data) return NULL;
+  *data = '\0'; return ows (data+1);
 }
 
 static char *token_colon (char **token, char *data) {
-  int c; *token = data;
-  while ((c = *data)) {
-    if (c == ':') { *data = '\0'; return ows (data+1); } data++;
-  } return NULL;
+  *token = data; data = scan2 (data, ':', ':');
+  if (!*data) return NULL;
+  *data = '\0'; return ows (data+1);
+}
+
+/* Header field names recognized by http_receive, indexed by a perfect hash
+   of the length and the first character. The hash ignores the case of the
+   first letter (upper and lower case differ by 0x20). */
+const char * const http_headers[] =
+  {"host", "accept", "content-type", "content-length", "connection",
+   "location", "transfer-encoding", "retry-after"};
+#define HTTP_HEADERS 8
+
+static const int8_t header_slots[16] =
+  {0, -1, -1, -1, -1, -1, 6, 4, 7, -1, -1, 2, 5, 1, -1, 3};
+
+// return the index of a header field name, HTTP_HEADERS if not recognized
+static int header_index (const char *name) {
+  int n = strlen (name), i = header_slots[(n * 2 + (uint8_t)*name) & 15];
+  if (i < 0 || strlen (http_headers[i]) != n
+      || strcasecmp (name, http_headers[i])) return HTTP_HEADERS;
+  return i;
+}
+
+/* Retry-After is either delta-seconds or an HTTP-date (IMF-fixdate, such as
+   "Sun, 06 Nov 1994 08:49:37 GMT"), returns the delay in seconds from now or
+   -1 if the value is not valid */
+static int retry_after (char *data) {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char month[4], *m; int64_t t;
+  int d, mon, y, hour, minute, second, era, yoe, doy;
+  if ((m = number (&d, data)) && *ows (m) == '\0') return d;
+  if (sscanf (data, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT",
+	      &d, month, &y, &hour, &minute, &second) != 6
+      || !(m = strstr (months, month)) || (m - months) % 3) return -1;
+  // days since the epoch from the civil date, March based years
+  mon = (m - months) / 3 + 1; y -= mon <= 2; era = y / 400;
+  yoe = y - era * 400; doy = (153 * (mon + (mon > 2? -3 : 9)) + 2) / 5 + d - 1;
+  t = (int64_t)era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+  t = t * 86400 + hour * 3600 + minute * 60 + second - time (NULL);
+  return t < 0? 0 : min (t, INT_MAX);
 }
 
@@ -3,65 +3,94 @@
 
 #include <errno.h>
 
-int event_poll (void **any, int timeout) {
-  PollEvent *pe; TcpPort *p; uint64_t value;
-  static struct epoll_event events[MAX_EVENTS];
-  static int i = 0, n = 0; int event;
-  static PollEvent *prev = NULL;
-  if (prev) {
-    if (!event_done (prev)) queue_add (&_active, prev);
-    prev = NULL;
+int reactor_wait (Reactor *r, void **any, int timeout) {
+  PollEvent *pe; WheelNode *node; uint64_t value; int event;
+  _reactor = r;
+  if (r->prev) {
+    if (!event_done (r->prev)) queue_add (&r->active, r->prev);
+    r->prev = NULL;
   }
  poll:
-  if (i == n) {
-    if (pe = queue_remove (&_active)) {
+  if (r->i == r->n) {
+    if (pe = queue_remove (&r->active)) {
       event = pe->type;
       switch (pe->type) {
-      case TCP_ACCEPTOR: goto accept;
-      case TCP_ACCEPT: case TCP_CONNECT:
+      case TCP_CONNECT:
+	// a port closed and reconnected before its TCP_CLOSED was delivered
+	if (pe->status != Connected) goto poll;
+      case TCP_ACCEPT:
 	pe->type = TCP_PORT;
       case TCP_PORT: case UDP_PORT:
-	prev = pe;
+	r->prev = pe;
       } *any = pe; return event;
     }
+    if (node = wheel_expired (&r->wheel)) {
+      switch (node->type) {
+      case TCP_ATTEMPT: race_next (node->data); goto poll;
+      case TCP_ACCEPTOR: accept_drain (node->data); goto poll;
+      }
+      *any = node->data; return node->type;
+    }
+    if (r->post.pending && (event = post_next (&r->post, any)))
+      return event;
   retry:
-    n = epoll_wait (poll_fd, events, MAX_EVENTS, timeout); i = 0;
-    if (n < 0) goto retry; // perror ("event_poll");
-    if (n == 0) return POLL_TIMEOUT;
+    r->n = epoll_wait (r->poll_fd, r->events, MAX_EVENTS, timeout);
+    r->i = 0;
+    if (r->n < 0) goto retry; // perror ("event_poll");
+    if (r->n == 0) return POLL_TIMEOUT;
   }
-  event = events[i].events; *any = pe = events[i].data.ptr; i++;
+  event = r->events[r->i].events;
+  *any = pe = r->events[r->i].data.ptr; r->i++;
   // printf ("event_poll %x %p %d\n", event, pe, pe->type);
   switch (pe->type) {
-  case TCP_CONNECT: p = *any;
+  case TCP_CONNECT:
     if (event & EPOLLOUT && bsd_connected (pe->socket)) {
       clear_timeout (pe);
       pe->status = Connected; pe->type = TCP_PORT;
-      prev = pe; return TCP_CONNECT;
+      r->prev = pe; return TCP_CONNECT;
     }
     if (event & EPOLLRDHUP || event & EPOLLHUP)
       net_close (*any);
     goto poll;
-  case TCP_PORT: prev = pe;
+  case TCP_PORT: r->prev = pe;
     clear_timeout (pe);
+    if (event & EPOLLOUT && ((TcpPort *)pe)->blocked) {
+      // return TCP_PORT from the queue if there is also data to read
+      ((TcpPort *)pe)->blocked = 0;
+      if (event & EPOLLIN) pe->end = 0;
+      else r->prev = NULL;
+      return TCP_WRITABLE;
+    }
     if (event & EPOLLIN)
       return TCP_PORT;
     if (event & EPOLLRDHUP || event & EPOLLHUP) {
-      pe->status = Closed; prev = NULL;
-      return TCP_CLOSED;
+      // close the socket, a recycled port must not receive its events
+      r->prev = NULL; net_close (pe); goto poll;
     } break;
-  accept:
+  case TCP_ATTEMPT:
+    if (pe->socket < 0) goto poll; // closed
+    if (event & EPOLLOUT && bsd_connected (pe->socket)) {
+      *any = pe = &race_won ((Attempt *)pe)->pe;
+      r->prev = pe; return TCP_CONNECT;
+    }
+    if (event & EPOLLRDHUP || event & EPOLLHUP)
+      race_failed ((Attempt *)pe);
+    goto poll;
+  case TCP_ACCEPT: case TCP_CLOSED:
+    // queued, an event from the batch must not return the port twice
+    goto poll;
   case TCP_ACCEPTOR:
-    if (prev = accept_queued (pe)) {
-      queue_add (&_active, pe);
-      prev->type = TCP_PORT;
-      *any = prev;
-      return TCP_ACCEPT;
-    } goto poll;
+    accept_drain ((Acceptor *)pe); goto poll;
   case TIMER_EVENT:
     read (pe->fd, &value, 8);
-    if (pe->id == TCP_TIMEOUT)
-      *any = tcp_expired ();
-    return pe->id;
+    wheel_advance (&r->wheel, clock_ms ());
+    goto poll;
+  case POST_EVENT:
+    post_wake ((PostQueue *)pe); goto poll;
   }
   return pe->type;
 }
+
+int event_poll (void **any, int timeout) {
+  return reactor_poll (_reactor, any, timeout);
+}
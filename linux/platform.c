@@ -5,10 +5,14 @@
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 
 #define print_error(func) perror (func)
 
@@ -23,21 +27,27 @@ typedef struct _PollEvent {
   char type, id;
   unsigned end : 1; // end of input
   unsigned status : 2; // connection status
-  unsigned wait : 1;
   union { int socket; int fd; };
 } PollEvent;
 
 #define MAX_EVENTS 10
 #define TCP_ACCEPTOR SYSTEM_EVENT
 
-int poll_fd;
-Timer *_tcp_timer;
+#include "wheel.c"
+#include "post.c"
 
-void platform_init () {
-  poll_fd = epoll_create (MAX_EVENTS);
-  _tcp_timer = add_timer (TCP_TIMEOUT);
-  signal (SIGPIPE, SIG_IGN);
-}
+// event loop state, one per thread
+typedef struct _Reactor {
+  int poll_fd;
+  int i, n; // next and number of epoll events
+  struct epoll_event events[MAX_EVENTS];
+  PollEvent *prev; // last port returned, queued again if not done
+  Queue active; // ports with pending events
+  Wheel wheel;
+  PostQueue post; // events posted from other threads
+} Reactor;
+
+__thread Reactor *_reactor = NULL;
 
 void non_block_enable (int fd) {
   fcntl (fd, F_SETFL, O_NONBLOCK);
@@ -47,16 +57,33 @@ int event_done (void *any) {
   PollEvent *pe = any; return pe->end;
 }
 
-void event_add (int fd, void *data) {
+void event_again (void *any) {
+  PollEvent *pe = any; pe->end = 0;
+}
+
+void poll_ctl (int poll_fd, int op, int fd, void *data) {
   struct epoll_event ev;
-  non_block_enable (fd);
   ev.events = EPOLLIN | EPOLLOUT
     | EPOLLRDHUP | EPOLLHUP | EPOLLET;
   ev.data.ptr = data;
-  epoll_ctl (poll_fd, EPOLL_CTL_ADD, fd, &ev);
+  epoll_ctl (poll_fd, op, fd, &ev);
+}
+
+void poll_add (int poll_fd, int fd, void *data) {
+  poll_ctl (poll_fd, EPOLL_CTL_ADD, fd, data);
+}
+
+void event_add (int fd, void *data) {
+  non_block_enable (fd); poll_add (_reactor->poll_fd, fd, data);
 }
 
-Queue _active = {0};
+void wheel_arm (Wheel *w, uint64_t t) {
+  struct itimerspec it = {0};
+  it.it_value.tv_sec = t / 1000;
+  it.it_value.tv_nsec = (t % 1000) * 1000000;
+  timerfd_settime (w->pe.fd, TFD_TIMER_ABSTIME, &it, NULL);
+  w->armed = t;
+}
 
 #include "time.c"
 #include "timer.c"
@@ -66,4 +93,22 @@ Queue _active = {0};
 #include "interface.c"
 #include "file.c"
 
+Reactor *reactor_new () {
+  Reactor *r = type_alloc (Reactor);
+  r->poll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  wheel_init (&r->wheel);
+  r->wheel.pe.fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  r->wheel.pe.end = 1; poll_add (r->poll_fd, r->wheel.pe.fd, &r->wheel);
+  post_init (&r->post); poll_add (r->poll_fd, r->post.pe.fd, &r->post);
+  return r;
+}
+
+#include "reactor.c"
+#include "stats.c"
+
+void platform_init () {
+  reactor_select (reactor_new ());
+  signal (SIGPIPE, SIG_IGN);
+}
+
 #endif
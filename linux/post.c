@@ -0,0 +1,76 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/* Events posted to a Reactor from other threads, shared by the epoll and
+   io_uring backends. The queue is a lock free multiple producer single
+   consumer queue (D. Vyukov), producers exchange the head and then link the
+   previous head to the new node, the reactor thread consumes from the tail.
+   A producer writes to the eventfd only if the reactor has not already been
+   signaled, the reactor clears the signal before it takes posted events so
+   that an event posted after the queue is found empty signals again. */
+
+#include <sys/eventfd.h>
+
+#define POST_EVENT (SYSTEM_EVENT+1)
+
+typedef struct _Post {
+  struct _Post *next;
+  void *data; int type;
+} Post;
+
+typedef struct {
+  PollEvent pe; // eventfd
+  Post *head; // last node posted
+  Post *tail; // next node to consume
+  Post stub; // keeps the queue non empty
+  int signaled; // the eventfd was written and not yet read
+  int pending; // posted events may be available (reactor thread only)
+} PostQueue;
+
+void post_init (PostQueue *q) {
+  q->pe.type = POST_EVENT; q->pe.end = 1;
+  q->pe.fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  q->head = q->tail = &q->stub;
+}
+
+void post_push (PostQueue *q, Post *p) { Post *prev;
+  __atomic_store_n (&p->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n (&q->head, p, __ATOMIC_ACQ_REL);
+  __atomic_store_n (&prev->next, p, __ATOMIC_RELEASE);
+}
+
+// return the next posted node or NULL if none is available
+Post *post_pop (PostQueue *q) {
+  Post *tail = q->tail, *next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE);
+  if (tail == &q->stub) {
+    if (!next) return NULL;
+    q->tail = tail = next;
+    next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE);
+  }
+  if (next) { q->tail = next; return tail; }
+  // a producer has exchanged the head but not yet linked the node
+  if (tail != __atomic_load_n (&q->head, __ATOMIC_ACQUIRE)) return NULL;
+  post_push (q, &q->stub);
+  if (next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE)) {
+    q->tail = next; return tail;
+  } return NULL;
+}
+
+void post_signal (PostQueue *q) { uint64_t one = 1;
+  if (!__atomic_exchange_n (&q->signaled, 1, __ATOMIC_SEQ_CST))
+    write (q->pe.fd, &one, 8);
+}
+
+// the eventfd is readable, clear the signal before taking events
+void post_wake (PostQueue *q) { uint64_t value;
+  read (q->pe.fd, &value, 8);
+  __atomic_store_n (&q->signaled, 0, __ATOMIC_SEQ_CST);
+  q->pending = 1;
+}
+
+// return the next posted event or EVENT_NONE
+int post_next (PostQueue *q, void **any) { Post *p; int type;
+  if (!(p = post_pop (q))) return q->pending = 0;
+  *any = p->data; type = p->type; free (p);
+  return type;
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/* Happy Eyeballs (RFC 8305), shared by the epoll and io_uring backends. The
+   connection attempts to the addresses of a server are started in order,
+   each after a delay or as soon as the previous attempt fails. The first
+   attempt to connect gives its socket to the TcpPort, the others are closed.
+   The backend starts and closes attempts (attempt_start, attempt_close) and
+   has the port adopt the socket of the winner (port_adopt). Attempts refer to
+   the port and are kept with it, so a completion for a closed attempt finds
+   its socket is -1. */
+
+#define RACE_ADDRS 4 // addresses raced for a connection
+#define TCP_ATTEMPT (SYSTEM_EVENT+2) // start the next attempt, internal
+
+typedef struct _Attempt {
+  PollEvent pe; // socket is -1 when closed
+  TcpPort *port;
+  Address addr;
+} Attempt;
+
+typedef struct _Race {
+  WheelNode delay; // start the next attempt
+  Attempt attempt[RACE_ADDRS];
+  int n, next, open; // addresses, next attempt to start, attempts open
+} Race;
+
+int attempt_start (Attempt *a);
+void attempt_close (Attempt *a);
+void port_adopt (TcpPort *p, int socket, Address *addr);
+
+int _attempt_delay = 250;
+
+void net_attempt_delay (int ms) { _attempt_delay = ms; }
+
+void race_init (TcpPort *p, Address *addrs, int n) {
+  Race *r = p->race? p->race : (p->race = type_alloc (Race)); int i;
+  r->n = min (n, RACE_ADDRS); r->next = r->open = 0;
+  r->delay.data = r; r->delay.type = TCP_ATTEMPT;
+  for (i = 0; i < r->n; i++) { Attempt *a = &r->attempt[i];
+    a->pe.type = TCP_ATTEMPT; a->pe.socket = -1; a->port = p;
+    address_copy (&a->addr, &addrs[i]);
+  }
+}
+
+// close the attempts still open
+void race_end (Race *r) { int i;
+  wheel_cancel (&_reactor->wheel, &r->delay);
+  for (i = 0; i < r->next; i++)
+    if (r->attempt[i].pe.socket >= 0) attempt_close (&r->attempt[i]);
+  r->next = r->n; r->open = 0;
+}
+
+// start the next attempt, or close the port if every attempt failed
+void race_next (Race *r) {
+  while (r->next < r->n)
+    if (attempt_start (&r->attempt[r->next++])) {
+      r->open++;
+      if (r->next < r->n)
+	wheel_set (&_reactor->wheel, &r->delay, clock_ms () + _attempt_delay);
+      return;
+    }
+  if (!r->open) net_close (r->attempt[0].port);
+}
+
+void race_failed (Attempt *a) { Race *r = a->port->race;
+  attempt_close (a); r->open--;
+  wheel_cancel (&_reactor->wheel, &r->delay); race_next (r);
+}
+
+// the attempt connected, returns the port
+TcpPort *race_won (Attempt *a) {
+  TcpPort *p = a->port; int socket = a->pe.socket;
+  a->pe.socket = -1; race_end (p->race);
+  port_adopt (p, socket, &a->addr); return p;
+}
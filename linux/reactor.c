@@ -0,0 +1,41 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+// Reactor threads, shared by the epoll and io_uring backends
+
+void reactor_select (Reactor *r) { _reactor = r; }
+
+Reactor *reactor_current () { return _reactor; }
+
+void reactor_post (Reactor *r, void *data, int type) {
+  Post *p = malloc (sizeof (Post));
+  p->data = data; p->type = type;
+  post_push (&r->post, p); post_signal (&r->post);
+}
+
+void reactor_pin (int cpu) {
+  unsigned long mask[16] = {0}; int bits = 8 * sizeof (long);
+  mask[cpu / bits] |= 1UL << (cpu % bits);
+  if (syscall (SYS_sched_setaffinity, 0, sizeof (mask), mask) < 0)
+    print_error ("reactor_pin");
+}
+
+typedef struct {
+  int cpu; void (*run) (void *); void *ctx;
+} ReactorStart;
+
+void *reactor_start (void *arg) {
+  ReactorStart s = *(ReactorStart *)arg; free (arg);
+  if (s.cpu >= 0) reactor_pin (s.cpu);
+  reactor_select (reactor_new ());
+  s.run (s.ctx); return NULL;
+}
+
+int reactor_thread (int cpu, void (*run) (void *), void *ctx) {
+  ReactorStart *s = malloc (sizeof (ReactorStart)); pthread_t t;
+  s->cpu = cpu; s->run = run; s->ctx = ctx;
+  if (pthread_create (&t, NULL, reactor_start, s)) {
+    free (s); return 0;
+  } pthread_detach (t); return 1;
+}
+
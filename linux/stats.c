@@ -0,0 +1,89 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/* Event loop statistics, shared by the epoll and io_uring backends. The
+   time an event is handled is the time from the poll function returning the
+   event until a poll function (event_poll or next_event) is called again,
+   poll functions call event_mark to close the last event and open the next. */
+
+__thread LoopStats *_loop_stats = NULL;
+__thread uint64_t _mark_time; __thread int _mark_type = EVENT_NONE;
+__thread int _dumped = 0;
+volatile sig_atomic_t _stats_dump = 0;
+
+uint64_t clock_us () { struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+LoopStats *event_stats_enable (int budget) {
+  if (!_loop_stats) _loop_stats = type_alloc (LoopStats);
+  _loop_stats->budget = budget; return _loop_stats;
+}
+
+LoopStats *event_stats () { return _loop_stats; }
+
+void depth_sample (DepthStats *d, Queue *q) {
+  int n = list_length (q->first);
+  d->samples++; d->total += n; d->max = max (d->max, n);
+}
+
+// bucket i counts times less than 2^i microseconds
+int stats_bucket (uint64_t us) { int i = 0;
+  while (us && i < EVENT_BUCKETS-1) { us >>= 1; i++; }
+  return i;
+}
+
+void event_mark (int type) {
+  LoopStats *s = _loop_stats; EventStats *e; uint64_t now, us;
+  if (!s) return;
+  now = clock_us ();
+  if (_mark_type != EVENT_NONE) {
+    us = now - _mark_time;
+    e = &s->type[min (_mark_type, EVENT_TYPES-1)];
+    e->count++; e->total += us; e->max = max (e->max, us);
+    e->histogram[stats_bucket (us)]++;
+    if (s->budget && us > s->budget * 1000ULL) {
+      s->stalls++;
+      printf ("event loop stall: event type %d handled in %ld ms\n",
+	      _mark_type, (long)(us / 1000));
+    }
+  }
+  if (_dumped != _stats_dump) { _dumped = _stats_dump; print_event_stats (s); }
+  _mark_type = type; _mark_time = now;
+}
+
+void print_depth (const char *name, DepthStats *d) {
+  if (d->samples)
+    printf ("  %-8s depth average %.2f, maximum %d\n", name,
+	    (double)d->total / d->samples, d->max);
+}
+
+void print_event_stats (LoopStats *s) { EventStats *e; int i, j;
+  printf ("event loop statistics, %ld stalls (budget %d ms)\n",
+	  (long)s->stalls, s->budget);
+  for (i = 0; i < EVENT_TYPES; i++) {
+    if (!(e = &s->type[i])->count) continue;
+    printf ("  type %2d: %8ld events, average %6ld us, maximum %6ld us\n"
+	    "    histogram (us <):", i, (long)e->count,
+	    (long)(e->total / e->count), (long)e->max);
+    for (j = 0; j < EVENT_BUCKETS; j++)
+      if (e->histogram[j]) printf (" %ld:%u", 1L << j, e->histogram[j]);
+    printf ("\n");
+  }
+  print_depth ("active", &s->active);
+  print_depth ("queued", &s->queued);
+  fflush (stdout);
+}
+
+void stats_signal (int sig) { _stats_dump++; }
+
+void event_stats_signal (int sig) { signal (sig, stats_signal); }
+
+int reactor_poll (Reactor *r, void **any, int timeout) { int event;
+  if (!_loop_stats) return reactor_wait (r, any, timeout);
+  event_mark (EVENT_NONE); depth_sample (&_loop_stats->active, &r->active);
+  event = reactor_wait (r, any, timeout);
+  event_mark (event == POLL_TIMEOUT? EVENT_NONE : event);
+  return event;
+}
@@ -6,8 +6,9 @@
 
 typedef struct _TcpPort {
   PollEvent pe;
-  struct _TcpPort *prev;
-  ClockTime timeout;
+  WheelNode timeout;
+  unsigned blocked : 1; // a write blocked, return TCP_WRITABLE on EPOLLOUT
+  struct _Race *race; // connection attempts (race.c), NULL if not raced
 } TcpPort;
 
 TcpPort *new_tcp_port () {
@@ -17,6 +18,8 @@ TcpPort *new_tcp_port () {
 typedef struct _Acceptor {
   PollEvent pe;
   Queue ports;
+  WheelNode retry; // accept again once descriptors are available
+  unsigned ready : 1; // connections may be waiting in the listen backlog
 } Acceptor;
 
 Acceptor *net_listen (Address *address) {
@@ -30,106 +33,110 @@ Acceptor *net_listen (Address *address) {
 #define event_pending(c) (errno == EAGAIN || errno == EWOULDBLOCK \
 			  || errno == EINPROGRESS)
 
-int accepted (TcpPort *p, Acceptor *a) { Address host;
-  host.length = sizeof (Address);
-  p->pe.socket = accept (a->pe.socket, (struct sockaddr *)&host,
-		      &host.length);
-  if (p->pe.socket == -1) {
-    a->pe.end = 1; return 0;
+// open an accepted socket on a port and queue the TCP_ACCEPT event
+void accepted (TcpPort *p, int socket) {
+  p->pe.socket = socket; p->pe.status = Connected;
+  p->pe.end = 0; p->blocked = 0;
+  p->pe.type = TCP_ACCEPT; p->pe.next = NULL;
+  poll_add (_reactor->poll_fd, socket, p);
+  queue_add (&_reactor->active, p);
+}
+
+// declared by <sys/socket.h> only with _GNU_SOURCE
+int accept4 (int socket, struct sockaddr *address, socklen_t *length,
+	     int flags);
+
+/* The listening socket is edge triggered, so connections are accepted with
+   accept4 (non-blocking sockets without a separate fcntl) until the backlog
+   would block or no port is queued. Connections without a port wait in the
+   listen backlog (see net_backlog) until net_accept queues one. Without
+   descriptors (EMFILE, ENFILE) no new edge is reported for the connections
+   waiting, the Acceptor tries again after a delay. */
+void accept_drain (Acceptor *a) { TcpPort *p; int fd;
+  a->ready = 1;
+  while (p = queue_peek (&a->ports)) {
+    if ((fd = accept4 (a->pe.socket, NULL, NULL,
+		       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+      queue_remove (&a->ports); accepted (p, fd);
+    } else if (event_pending (a)) {
+      a->ready = 0; return;
+    } else if (errno != ECONNABORTED && errno != EINTR) {
+      a->retry.data = a; a->retry.type = TCP_ACCEPTOR;
+      wheel_set (&_reactor->wheel, &a->retry, clock_ms () + ACCEPT_RETRY);
+      return;
+    }
   }
-  p->pe.status = Connected;
-  non_block_enable (p->pe.socket); 
-  event_add (p->pe.socket, p);
-  return 1;
 }
 
 void net_accept (void *port, Acceptor *a) {
   TcpPort *p = port;
-  p->pe.next = NULL;
-  if (accepted (p, a)) {
-    p->pe.type = TCP_ACCEPT; 
-    queue_add (&_active, p);
-  } else queue_add (&a->ports, p);
-}
-
-void *accept_queued (void *any) {
-  Acceptor *a = any; TcpPort *p;
-  if (p = queue_peek (&a->ports)) {
-    if (accepted (p, a))
-      return queue_remove (&a->ports);
-  } return NULL;
+  p->pe.next = NULL; queue_add (&a->ports, p);
+  if (a->ready) accept_drain (a);
 }
 
 int net_status (void *port) {
   TcpPort *p = port; return p->pe.status;
 }
 
-Queue _tcp_wait = {0};
 int _tcp_timeout = 10;
 
 void net_timeout (int seconds) {
   _tcp_timeout = seconds;
 }
 
-int compare_timeout (void *a, void *b) {
-  TcpPort *p1 = a, *p2 = b;
-  int diff = p1->timeout.spec.tv_sec - p2->timeout.spec.tv_sec;
-  return diff? diff : p1->timeout.spec.tv_nsec - p2->timeout.spec.tv_nsec;
-}
-
 void set_timeout (void *port) {
   TcpPort *p = port;
   // printf ("set_timeout %p\n", port);
-  clock_gettime (CLOCK_MONOTONIC, &p->timeout.spec);
-  p->timeout.spec.tv_sec += _tcp_timeout;
-  p->prev = NULL;
-  p->pe.wait = 1;
-  _queue_insert (&_tcp_wait, p, &p->prev, compare_timeout);
-  p = queue_peek (&_tcp_wait);
-  set_timer_ct (_tcp_timer, &p->timeout);
+  p->timeout.data = p; p->timeout.type = TCP_TIMEOUT;
+  wheel_set (&_reactor->wheel, &p->timeout, clock_ms () + _tcp_timeout * 1000);
 }
 
-// remove connection from either the wait list or old list
 void clear_timeout (void *port) {
   TcpPort *p = port;
   // printf ("clear_timeout %p\n", port);
-  if (p->pe.wait) {
-    p->pe.wait = 0;
-    if (p->prev) {
-      p->prev->pe.next = p->pe.next;
-      p->prev = NULL;
-    } else {
-      queue_remove (&_tcp_wait);
-      if (p = queue_peek (&_tcp_wait))
-	set_timer_ct (_tcp_timer, &p->timeout);
-      else set_timer (_tcp_timer, 0);
-    }
-  }
+  wheel_cancel (&_reactor->wheel, &p->timeout);
 }
 
-void *tcp_expired () { TcpPort *p, *q; 
-  if (p = queue_remove (&_tcp_wait)) {
-    if (q = queue_peek (&_tcp_wait))
-      set_timer_ct (_tcp_timer, &q->timeout);
-    else set_timer (_tcp_timer, 0);
-    return p;
-  } return NULL;
+#include "race.c"
+
+// attempts are registered with epoll, TCP_ATTEMPT events are handled by
+// reactor_wait
+int attempt_start (Attempt *a) {
+  if ((a->pe.socket = bsd_socket (a->addr.family)) < 0) return 0;
+  event_add (a->pe.socket, a);
+  if (connect (a->pe.socket, (struct sockaddr *)&a->addr,
+	       a->addr.length) < 0 && !event_pending (a)) {
+    close (a->pe.socket); a->pe.socket = -1; return 0;
+  } return 1;
+}
+
+void attempt_close (Attempt *a) {
+  close (a->pe.socket); a->pe.socket = -1;
+}
+
+void port_adopt (TcpPort *p, int socket, Address *addr) {
+  poll_ctl (_reactor->poll_fd, EPOLL_CTL_MOD, socket, p);
+  p->pe.socket = socket; p->pe.end = 0; p->blocked = 0;
+  clear_timeout (p);
+  p->pe.status = Connected; p->pe.type = TCP_PORT;
 }
 
 void net_close (void *port) {
-  PollEvent *pe = port;
+  PollEvent *pe = port; TcpPort *p = port;
   printf ("net_close\n");
   switch (pe->type) {
   case TCP_CONNECT:
   case TCP_PORT:
-    pe->status = Closed;
+    if (p->race) race_end (p->race);
+    pe->status = Closed; p->blocked = 0;
     pe->type = TCP_CLOSED;
     pe->end = 1;
     close (pe->socket);
     clear_timeout (pe);
-    queue_add (&_active, pe);
+    queue_add (&_reactor->active, pe);
     break;
   case TCP_ACCEPTOR:
+    wheel_cancel (&_reactor->wheel, &((Acceptor *)pe)->retry);
     close (pe->socket);
   }
 }
@@ -142,13 +149,21 @@ void net_connect (void *port, Address *server) {
   if (connect (p->pe.socket, (struct sockaddr *)server,
 	       server->length) == 0) {
     p->pe.status = Connected;
-    queue_add (&_active, p);
+    queue_add (&_reactor->active, p);
   } else if (event_pending (p)) {
     set_timeout (p);
     p->pe.status = InProgress;
   }
 }
 
+void net_connect_any (void *port, Address *addrs, int n) {
+  TcpPort *p = port;
+  if (n == 1) { net_connect (port, addrs); return; }
+  race_init (p, addrs, n);
+  p->pe.socket = -1; p->pe.type = TCP_CONNECT; p->pe.status = InProgress;
+  set_timeout (p); race_next (p->race);
+}
+
 int net_read (void *port, char *buffer, int size) {
   TcpPort *p = port; int n = -1;
   if (p->pe.status == Connected) {
@@ -159,9 +174,20 @@ int net_read (void *port, char *buffer, int size) {
 }
 
 int net_write (void *port, const char *data, int length) {
-  TcpPort *p = port;
-  return p->pe.status == Connected?
-    write (p->pe.socket, data, length) : -1;
+  TcpPort *p = port; int n;
+  if (p->pe.status != Connected) return -1;
+  n = write (p->pe.socket, data, length);
+  if (n < length) p->blocked = 1;
+  return n;
+}
+
+int net_writev (void *port, const struct iovec *iov, int n) {
+  TcpPort *p = port; int i, length = 0, ret;
+  if (p->pe.status != Connected) return -1;
+  for (i = 0; i < n; i++) length += iov[i].iov_len;
+  ret = writev (p->pe.socket, iov, n);
+  if (ret < length) p->blocked = 1;
+  return ret;
 }
 
 Address *net_remote (Address *addr, void *port) {
@@ -1,57 +1,43 @@
 // Copyright (c) 2018 Electric Power Research Institute, Inc.
 // author: Mark Slicker <mark.slicker@gmail.com>
 
-#include <sys/timerfd.h>
-
 typedef struct _Timer {
-  PollEvent pe;
+  WheelNode node;
 } Timer;
 
 typedef struct _ClockTime {
   struct timespec spec;
 } ClockTime;
 
-void set_timer (Timer *timer, int timeout) {
-  struct itimerspec it = {0};
-  it.it_interval.tv_sec = timeout;
-  it.it_value.tv_sec = timeout;
-  //printf ("set_timer %x %d %d\n", timer, time (NULL), timeout);
-  timerfd_settime (timer->pe.fd, 0, &it, NULL);
+void set_timer_ms (Timer *timer, int ms) {
+  timer->node.interval = ms;
+  if (ms) wheel_set (&_reactor->wheel, &timer->node, clock_ms () + ms);
+  else wheel_cancel (&_reactor->wheel, &timer->node);
 }
 
-void set_timer_ms (Timer *timer, int ms) {
-  struct itimerspec it = {0};
-  int seconds = ms / 1000;
-  ms -= seconds * 1000;
-  it.it_interval.tv_sec = seconds;
-  it.it_interval.tv_nsec = ms * 1000000;
-  it.it_value.tv_sec = seconds;
-  it.it_value.tv_nsec = ms * 1000000;
+void set_timer (Timer *timer, int timeout) {
   //printf ("set_timer %x %d %d\n", timer, time (NULL), timeout);
-  timerfd_settime (timer->pe.fd, 0, &it, NULL);
+  set_timer_ms (timer, timeout * 1000);
 }
 
 void set_timer_ct (Timer *timer, ClockTime *ct) {
-  struct timespec t; struct itimerspec it = {0}; long diff;
-  clock_gettime (CLOCK_MONOTONIC, &t);
-  //  printf ("set_timer_ct %d %d\n", t.tv_sec, ct->spec.tv_sec);
-  t.tv_sec = ct->spec.tv_sec - t.tv_sec;
-  diff = ct->spec.tv_nsec - t.tv_nsec;
-  if (diff >= 0) t.tv_nsec = diff;
-  else {
-    t.tv_sec--;
-    t.tv_nsec = diff + 1000000000;
-  }
-  memcpy (&it.it_value, &t, sizeof (struct timespec));
-  timerfd_settime (timer->pe.fd, 0, &it, NULL);
+  uint64_t t = ct->spec.tv_sec * 1000ULL + ct->spec.tv_nsec / 1000000;
+  timer->node.interval = 0;
+  wheel_set (&_reactor->wheel, &timer->node, t);
+}
+
+void set_timer_at (Timer *timer, uint64_t ms) {
+  timer->node.interval = 0;
+  wheel_set (&_reactor->wheel, &timer->node, ms);
+}
+
+void timer_init (Timer *timer, int id, void *data) {
+  timer->node.data = data; timer->node.type = id;
 }
 
 Timer *add_timer (int id) {
-  Timer *timer = malloc (sizeof (Timer));
-  timer->pe.type = TIMER_EVENT; timer->pe.id = id;
-  timer->pe.fd = timerfd_create (CLOCK_MONOTONIC, 0);
-  timer->pe.end = 1; event_add (timer->pe.fd, timer);
-  return timer;
+  Timer *timer = type_alloc (Timer);
+  timer_init (timer, id, timer); return timer;
 }
 
 Timer *new_timer (int id, int timeout) {
@@ -1,10 +1,29 @@
 // Copyright (c) 2015 Electric Power Research Institute, Inc.
 // author: Mark Slicker <mark.slicker@gmail.com>
 
+#define UDP_BATCH 16 // datagrams received with one recvmmsg call
+
+// struct mmsghdr, <sys/socket.h> only declares it with _GNU_SOURCE
+typedef struct {
+  struct msghdr hdr;
+  unsigned int length;
+} UdpMessage;
+
+// ring of datagrams filled by recvmmsg
+typedef struct {
+  UdpMessage msg[UDP_BATCH];
+  struct iovec iov[UDP_BATCH];
+  Address source[UDP_BATCH];
+  int next, count; // next datagram to return, number received
+  int drained; // the last batch was short, the socket queue is empty
+  char buffer[];
+} UdpRing;
+
 typedef struct _UdpPort {
   PollEvent pe;
   Address source;
   int size;
+  UdpRing *ring; // allocated by the first net_receive_batch
   char buffer[];
 } UdpPort;
 
@@ -17,6 +36,34 @@ char *net_receive (UdpPort *p, int *length) {
   return *length < 0? NULL : p->buffer;
 }
 
+UdpRing *udp_ring (UdpPort *p) { int i;
+  UdpRing *r = calloc (1, sizeof (UdpRing) + p->size * UDP_BATCH);
+  for (i = 0; i < UDP_BATCH; i++) {
+    r->iov[i].iov_base = r->buffer + p->size * i;
+    r->iov[i].iov_len = p->size;
+    r->msg[i].hdr.msg_iov = &r->iov[i]; r->msg[i].hdr.msg_iovlen = 1;
+    r->msg[i].hdr.msg_name = &r->source[i];
+  } return p->ring = r;
+}
+
+char *net_receive_batch (UdpPort *p, int *length) {
+  UdpRing *r = p->ring? p->ring : udp_ring (p); int i, n;
+  if (r->next == r->count) {
+    r->next = r->count = 0;
+    // a datagram arriving after a short batch signals the port again
+    if (r->drained) { r->drained = 0; p->pe.end = 1; return NULL; }
+    for (i = 0; i < UDP_BATCH; i++)
+      r->msg[i].hdr.msg_namelen = sizeof (Address);
+    if ((n = syscall (SYS_recvmmsg, p->pe.socket, r->msg, UDP_BATCH,
+		      0, NULL)) <= 0) {
+      p->pe.end = 1; return NULL;
+    } r->count = n; r->drained = n < UDP_BATCH;
+  }
+  i = r->next++; *length = r->msg[i].length;
+  p->source = r->source[i]; p->source.length = r->msg[i].hdr.msg_namelen;
+  return r->iov[i].iov_base;
+}
+
 int net_send (UdpPort *p, char *buffer, int length, Address *addr) {
   // printf ("udp_write %d\n", length); fflush (stdout);
   return sendto (p->pe.socket, buffer, length, 0,
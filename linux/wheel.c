@@ -0,0 +1,151 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/* Timers are kept in a hierarchical timing wheel driven by a single
+   system timer (a timerfd, or the io_uring wait timeout).
+   Level 0 has 64 slots of one millisecond, each higher level has 64 slots
+   that span the whole of the level below it. A WheelNode is placed in the
+   lowest level that covers its deadline and is moved down a level (cascaded)
+   when the wheel reaches its slot. Arming, re-arming and cancelling a node
+   are constant time, the system timer is only reprogrammed when the
+   earliest deadline changes. */
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE-1)
+#define WHEEL_LEVELS 5 // 2^30 ms, about 12 days
+
+typedef struct _WheelNode {
+  struct _WheelNode *next, *prev;
+  uint64_t expire; // deadline in milliseconds (CLOCK_MONOTONIC)
+  void *data; // event object returned by event_poll
+  int type; // event type returned by event_poll
+  int interval; // period in milliseconds, 0 for a single shot
+  int slot; // level * WHEEL_SIZE + slot index, -1 for the expired list
+} WheelNode;
+
+typedef struct {
+  PollEvent pe;
+  uint64_t now; // time the wheel has advanced to (ms)
+  uint64_t armed; // timerfd expiration (ms), 0 if disarmed
+  uint64_t bits[WHEEL_LEVELS]; // slot occupancy
+  WheelNode slot[WHEEL_LEVELS][WHEEL_SIZE];
+  WheelNode expired; // expired nodes waiting for event_poll
+} Wheel;
+
+/* program the system timer to expire at time t (ms), defined by the
+   platform backend */
+void wheel_arm (Wheel *w, uint64_t t);
+
+#define node_linked(n) ((n)->next != NULL)
+#define slot_empty(head) ((head)->next == (head))
+#define level_shift(l) ((l) * WHEEL_BITS)
+
+uint64_t clock_ms () { struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000ULL + t.tv_nsec / 1000000;
+}
+
+void node_link (WheelNode *head, WheelNode *n) {
+  n->prev = head->prev; n->next = head;
+  head->prev->next = n; head->prev = n;
+}
+
+void node_unlink (WheelNode *n) {
+  n->prev->next = n->next; n->next->prev = n->prev;
+  n->next = n->prev = NULL;
+}
+
+void wheel_insert (Wheel *w, WheelNode *n) {
+  uint64_t delta, t = n->expire; int l = 0, s;
+  if (t <= w->now) {
+    n->slot = -1; node_link (&w->expired, n); return;
+  }
+  delta = t - w->now;
+  if (delta >> level_shift (WHEEL_LEVELS)) { // beyond range, clamp
+    delta = (1ULL << level_shift (WHEEL_LEVELS)) - 1; t = w->now + delta;
+  }
+  while (delta >> level_shift (l+1)) l++;
+  s = (t >> level_shift (l)) & WHEEL_MASK;
+  n->slot = l * WHEEL_SIZE + s;
+  node_link (&w->slot[l][s], n);
+  w->bits[l] |= 1ULL << s;
+}
+
+void wheel_remove (Wheel *w, WheelNode *n) {
+  int l = n->slot / WHEEL_SIZE, s = n->slot & WHEEL_MASK;
+  node_unlink (n);
+  if (n->slot >= 0 && slot_empty (&w->slot[l][s]))
+    w->bits[l] &= ~(1ULL << s);
+}
+
+// return the next time (ms) the wheel needs to advance, 0 if empty
+uint64_t wheel_next (Wheel *w) {
+  uint64_t next = 0, bits, t; int l, r;
+  for (l = 0; l < WHEEL_LEVELS; l++) {
+    if (!(bits = w->bits[l])) continue;
+    // search the slots following the current slot, wrapping around
+    r = ((w->now >> level_shift (l)) + 1) & WHEEL_MASK;
+    bits = (bits >> r) | (bits << ((WHEEL_SIZE - r) & WHEEL_MASK));
+    t = ((w->now >> level_shift (l)) + __builtin_ctzll (bits) + 1)
+      << level_shift (l);
+    if (!next || t < next) next = t;
+  } return next;
+}
+
+// move the nodes from a slot to the expired list or a lower level
+void wheel_cascade (Wheel *w, int l, int s) {
+  WheelNode *head = &w->slot[l][s], *n;
+  w->bits[l] &= ~(1ULL << s);
+  while (!slot_empty (head)) {
+    n = head->next; node_unlink (n); wheel_insert (w, n);
+  }
+}
+
+void wheel_advance (Wheel *w, uint64_t now) {
+  uint64_t next; int l;
+  while ((next = wheel_next (w)) && next <= now) {
+    w->now = next;
+    for (l = WHEEL_LEVELS-1; l >= 0; l--)
+      if (!(next & ((1ULL << level_shift (l)) - 1)))
+	wheel_cascade (w, l, (next >> level_shift (l)) & WHEEL_MASK);
+  }
+  if (now > w->now) w->now = now;
+  if (next = wheel_next (w)) wheel_arm (w, next);
+  else w->armed = 0;
+}
+
+// arm or re-arm a node with a deadline
+void wheel_set (Wheel *w, WheelNode *n, uint64_t expire) {
+  uint64_t next;
+  if (node_linked (n)) wheel_remove (w, n);
+  else if (!w->armed && !wheel_next (w)) w->now = clock_ms ();
+  n->expire = expire; wheel_insert (w, n);
+  if (n->slot >= 0 && (next = wheel_next (w))
+      && (!w->armed || next < w->armed))
+    wheel_arm (w, next);
+}
+
+void wheel_cancel (Wheel *w, WheelNode *n) {
+  if (node_linked (n)) wheel_remove (w, n);
+}
+
+// return the next expired node, periodic nodes are re-armed
+WheelNode *wheel_expired (Wheel *w) {
+  WheelNode *n = w->expired.next;
+  if (n == &w->expired) return NULL;
+  node_unlink (n);
+  if (n->interval) // skip periods missed while the loop was busy
+    wheel_set (w, n, max (n->expire, w->now) + n->interval);
+  return n;
+}
+
+void wheel_init (Wheel *w) { int l, s;
+  memset (w, 0, sizeof (Wheel));
+  for (l = 0; l < WHEEL_LEVELS; l++)
+    for (s = 0; s < WHEEL_SIZE; s++)
+      w->slot[l][s].next = w->slot[l][s].prev = &w->slot[l][s];
+  w->expired.next = w->expired.prev = &w->expired;
+  w->pe.type = TIMER_EVENT; w->now = clock_ms ();
+}
+
@@ -0,0 +1,87 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+#include <errno.h>
+
+// process a completion, return an event type or 0 if there is no event
+int completion (Reactor *r, struct io_uring_cqe *cqe, void **any) {
+  uint64_t d = cqe->user_data; PollEvent *pe = data_ptr (d);
+  TcpPort *p = (TcpPort *)pe;
+  int res = cqe->res, more = cqe->flags & IORING_CQE_F_MORE, id = -1;
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    id = cqe->flags >> IORING_CQE_BUFFER_SHIFT; r->free--;
+  }
+  switch (data_op (d)) {
+  case OP_CANCEL: return 0;
+  case OP_POLL:
+    if (res < 0) return 0;
+    if (!more) event_add (pe->fd, pe);
+    if (pe->type == POST_EVENT) { post_wake ((PostQueue *)pe); return 0; }
+    pe->end = 0; *any = r->prev = pe;
+    return pe->type;
+  case OP_ACCEPT: return accept_complete ((Acceptor *)pe, res, any);
+  case OP_ATTEMPT:
+    return attempt_complete ((Attempt *)pe, data_gen (d), res, any);
+  }
+  if (data_gen (d) != (p->gen & 0x1fff)) { // stale completion
+    if (id >= 0) buffer_recycle (r, id);
+    return 0;
+  }
+  switch (data_op (d)) {
+  case OP_RECV: return tcp_received (p, res, id, more, any);
+  case OP_SEND: return tcp_sent (p, res, any);
+  case OP_CONNECT: return tcp_connected (p, res, any);
+  } return 0;
+}
+
+int reactor_wait (Reactor *r, void **any, int timeout) {
+  PollEvent *pe; WheelNode *node; struct io_uring_cqe *cqe;
+  uint64_t now, deadline = 0; int event, wait;
+  _reactor = r;
+  if (r->prev) {
+    if (!event_done (r->prev)) queue_add (&r->active, r->prev);
+    r->prev = NULL;
+  }
+  if (timeout >= 0) deadline = clock_ms () + timeout;
+ poll:
+  if (pe = queue_remove (&r->active)) {
+    event = pe->type;
+    switch (pe->type) {
+    case TCP_ACCEPT: case TCP_CONNECT:
+      pe->type = TCP_PORT;
+    case TCP_PORT: case UDP_PORT:
+      r->prev = pe;
+    } *any = pe; return event;
+  }
+  if (node = wheel_expired (&r->wheel)) {
+    switch (node->type) {
+    case TCP_ATTEMPT: race_next (node->data); goto poll;
+    case TCP_ACCEPTOR: accept_arm (node->data); goto poll;
+    }
+    *any = node->data; return node->type;
+  }
+  if (r->post.pending && (event = post_next (&r->post, any))) return event;
+  while (cqe = ring_cqe (&r->ring)) {
+    event = completion (r, cqe, any); ring_seen (&r->ring);
+    if (event) return event;
+  }
+  if (r->post.pending) goto poll;
+  if (r->starved && r->free) recv_starved (r);
+  now = clock_ms ();
+  if (r->wheel.armed && r->wheel.armed <= now) {
+    wheel_advance (&r->wheel, now); goto poll;
+  }
+  if (timeout >= 0 && now >= deadline) {
+    ring_enter (&r->ring, 0); return POLL_TIMEOUT;
+  }
+  // wait for a completion, a timer, or the poll timeout
+  wait = timeout >= 0? deadline - now : -1;
+  if (r->wheel.armed && (wait < 0 || r->wheel.armed - now < wait))
+    wait = r->wheel.armed - now;
+  ring_enter (&r->ring, wait);
+  goto poll;
+}
+
+int event_poll (void **any, int timeout) {
+  return reactor_poll (_reactor, any, timeout);
+}
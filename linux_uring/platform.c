@@ -0,0 +1,151 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/* Linux platform layer using io_uring (completion model), selected at
+   compile time with -DLINUX_URING. Sockets are read with multishot recv
+   into a ring of buffers provided to (registered with) the kernel, writes
+   are copied to a send buffer (borrowed from the reactor while data is
+   being sent) and submitted without a system call,
+   all pending submissions are flushed with a single io_uring_enter when
+   event_poll waits for completions. Timers, UDP, files and interfaces are
+   shared with the epoll backend (linux). */
+
+#include <netinet/tcp.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#define print_error(func) perror (func)
+
+#include "../bsd.c"
+#include "../file.c"
+
+#ifndef HEADER_ONLY
+
+// control/status
+typedef struct _PollEvent {
+  struct _PollEvent *next;
+  char type, id;
+  unsigned end : 1; // end of input
+  unsigned status : 2; // connection status
+  union { int socket; int fd; };
+} PollEvent;
+
+#define TCP_ACCEPTOR SYSTEM_EVENT
+
+#include "../linux/wheel.c"
+#include "../linux/post.c"
+#include "ring.c"
+
+#define RING_ENTRIES 256
+#define RX_BUFFERS 256 // number of receive buffers, a power of 2
+#define RX_SIZE 4096 // size of each receive buffer
+
+// receive buffer chunk, indexed by buffer id
+typedef struct {
+  int next; // next buffer id + 1, 0 for none
+  int offset, length; // unread data in the buffer
+} RxChunk;
+
+// event loop state, one per thread
+typedef struct _Reactor {
+  Ring ring;
+  PollEvent *prev; // last port returned, queued again if not done
+  Queue active; // ports with pending events
+  Wheel wheel;
+  struct io_uring_buf_ring *br; // provided receive buffers
+  char *buffers;
+  int free; // number of buffers available to the kernel
+  RxChunk rx[RX_BUFFERS];
+  struct _TcpPort *starved; // ports waiting for receive buffers
+  PostQueue post; // events posted from other threads
+  Pool sends; // send buffers, borrowed by ports while data is sent
+} Reactor;
+
+__thread Reactor *_reactor = NULL;
+
+void non_block_enable (int fd) {
+  fcntl (fd, F_SETFL, O_NONBLOCK);
+}
+
+int event_done (void *any) {
+  PollEvent *pe = any; return pe->end;
+}
+
+void event_again (void *any) {
+  PollEvent *pe = any; pe->end = 0;
+}
+
+// the wheel is serviced by event_poll, waiting at most until it is due
+void wheel_arm (Wheel *w, uint64_t t) { w->armed = t; }
+
+// return a receive buffer to the kernel
+void buffer_recycle (Reactor *r, int id) {
+  struct io_uring_buf *b = &r->br->bufs[r->br->tail & (RX_BUFFERS-1)];
+  b->addr = (uint64_t)(r->buffers + id * RX_SIZE);
+  b->len = RX_SIZE; b->bid = id;
+  __atomic_store_n (&r->br->tail, r->br->tail+1, __ATOMIC_RELEASE);
+  r->free++;
+}
+
+// multishot poll for readable, used by UdpPort
+void poll_add (Ring *ring, int fd, void *data) {
+  struct io_uring_sqe *sqe = ring_sqe (ring);
+  non_block_enable (fd);
+  sqe->opcode = IORING_OP_POLL_ADD; sqe->fd = fd;
+  sqe->len = IORING_POLL_ADD_MULTI; sqe->poll32_events = POLLIN;
+  sqe->user_data = ring_data (data, 0, OP_POLL);
+}
+
+void event_add (int fd, void *data) {
+  poll_add (&_reactor->ring, fd, data);
+}
+
+#include "../linux/time.c"
+#include "../linux/timer.c"
+#include "tcp.c"
+#include "../linux/udp.c"
+#include "event.c"
+#include "../linux/interface.c"
+#include "../linux/file.c"
+
+Reactor *reactor_new () {
+  Reactor *r = type_alloc (Reactor);
+  struct io_uring_buf_reg reg = {0}; int i;
+  if (ring_init (&r->ring, RING_ENTRIES) < 0) {
+    print_error ("reactor_new, io_uring_setup"); exit (1);
+  }
+  wheel_init (&r->wheel);
+  r->br = mmap (NULL, RX_BUFFERS * sizeof (struct io_uring_buf),
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  r->buffers = malloc (RX_BUFFERS * RX_SIZE);
+  reg.ring_addr = (uint64_t)r->br; reg.ring_entries = RX_BUFFERS;
+  if (ring_register (&r->ring, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    print_error ("reactor_new, IORING_REGISTER_PBUF_RING"); exit (1);
+  }
+  for (i = 0; i < RX_BUFFERS; i++) buffer_recycle (r, i);
+  post_init (&r->post); poll_add (&r->ring, r->post.pe.fd, &r->post);
+  r->sends.size = SEND_SIZE; return r;
+}
+
+#include "../linux/reactor.c"
+#include "../linux/stats.c"
+
+void platform_init () {
+  reactor_select (reactor_new ());
+  signal (SIGPIPE, SIG_IGN);
+}
+
+#endif
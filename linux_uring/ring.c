@@ -0,0 +1,102 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+// minimal io_uring interface using the system calls directly
+
+typedef struct {
+  int fd;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  unsigned entries; // number of submission queue entries
+  unsigned tail; // local submission queue tail
+  unsigned pending; // entries prepared but not yet submitted
+} Ring;
+
+// user_data: object pointer, generation, and operation
+#define OP_POLL 0
+#define OP_RECV 1
+#define OP_SEND 2
+#define OP_CONNECT 3
+#define OP_ACCEPT 4
+#define OP_CANCEL 5
+#define OP_ATTEMPT 6
+
+#define ring_data(ptr, gen, op) \
+  ((uint64_t)(ptr) << 16 | ((gen) & 0x1fff) << 3 | (op))
+#define data_ptr(d) ((void *)((d) >> 16))
+#define data_gen(d) (((d) >> 3) & 0x1fff)
+#define data_op(d) ((d) & 7)
+
+int ring_register (Ring *r, int op, void *arg, int n) {
+  return syscall (__NR_io_uring_register, r->fd, op, arg, n);
+}
+
+void *ring_map (Ring *r, size_t size, off_t offset) {
+  void *p = mmap (NULL, size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, r->fd, offset);
+  return p == MAP_FAILED? NULL : p;
+}
+
+int ring_init (Ring *r, int entries) {
+  struct io_uring_params p = {0}; char *sq, *cq;
+  p.flags = IORING_SETUP_CQSIZE; p.cq_entries = entries * 4;
+  if ((r->fd = syscall (__NR_io_uring_setup, entries, &p)) < 0) return -1;
+  sq = ring_map (r, p.sq_off.array + p.sq_entries * sizeof (unsigned),
+		 IORING_OFF_SQ_RING);
+  cq = ring_map (r, p.cq_off.cqes + p.cq_entries
+		 * sizeof (struct io_uring_cqe), IORING_OFF_CQ_RING);
+  r->sqes = ring_map (r, p.sq_entries * sizeof (struct io_uring_sqe),
+		      IORING_OFF_SQES);
+  if (!sq || !cq || !r->sqes) return -1;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  r->entries = p.sq_entries; r->tail = *r->sq_tail;
+  return 0;
+}
+
+/* submit pending entries and wait for a completion, wait is the timeout
+   in milliseconds, -1 to wait indefinitely, or 0 to only submit */
+int ring_enter (Ring *r, int wait) {
+  struct io_uring_getevents_arg arg = {0};
+  struct __kernel_timespec ts; int n = r->pending, flags = 0;
+  __atomic_store_n (r->sq_tail, r->tail, __ATOMIC_RELEASE);
+  r->pending = 0;
+  if (wait) {
+    flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (wait > 0) {
+      ts.tv_sec = wait / 1000; ts.tv_nsec = (wait % 1000) * 1000000;
+      arg.ts = (uint64_t)&ts;
+    }
+  } else if (!n) return 0;
+  return syscall (__NR_io_uring_enter, r->fd, n, wait? 1 : 0, flags,
+		  &arg, sizeof (arg));
+}
+
+// return a cleared submission queue entry, submitting if the queue is full
+struct io_uring_sqe *ring_sqe (Ring *r) {
+  struct io_uring_sqe *sqe; unsigned i;
+  if (r->tail - __atomic_load_n (r->sq_head, __ATOMIC_ACQUIRE) == r->entries)
+    ring_enter (r, 0);
+  i = r->tail & *r->sq_mask; r->sq_array[i] = i;
+  sqe = &r->sqes[i]; memset (sqe, 0, sizeof (struct io_uring_sqe));
+  r->tail++; r->pending++; return sqe;
+}
+
+// return the next completion or NULL, release it with ring_seen
+struct io_uring_cqe *ring_cqe (Ring *r) {
+  unsigned head = *r->cq_head;
+  if (head == __atomic_load_n (r->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+  return &r->cqes[head & *r->cq_mask];
+}
+
+void ring_seen (Ring *r) {
+  __atomic_store_n (r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
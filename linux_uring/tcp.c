@@ -0,0 +1,358 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+#include <errno.h>
+#include <time.h>
+
+/* Completions refer to the TcpPort by its address, a TcpPort can be reused
+   after it is closed (the generation is incremented so that completions of
+   the previous connection are ignored) but should not be freed. */
+
+#define SEND_SIZE 16384 // size of the pooled send buffers
+
+typedef struct _TcpPort {
+  PollEvent pe;
+  WheelNode timeout;
+  struct _TcpPort *starved; // next port waiting for receive buffers
+  int gen; // generation, incremented when the port is closed
+  int rx_head, rx_tail; // received chunks (buffer id + 1), 0 if none
+  unsigned recv : 1; // multishot recv armed
+  unsigned eof : 1; // end of stream or error
+  unsigned blocked : 1; // a write failed, return TCP_WRITABLE when sent
+  unsigned starving : 1; // in the starved list
+  Address addr; // address to connect to
+  struct _Race *race; // connection attempts (race.c), NULL if not raced
+  char *send; // send buffer, data [sent, length) is queued, NULL if idle
+  int size, length, sent, flight; // flight is the length being sent
+} TcpPort;
+
+TcpPort *new_tcp_port () {
+  return type_alloc (TcpPort);
+}
+
+typedef struct _Acceptor {
+  PollEvent pe;
+  Queue ports;
+  WheelNode retry; // accept again once descriptors are available
+  unsigned armed : 1; // an accept is submitted
+} Acceptor;
+
+#define event_pending(c) (errno == EAGAIN || errno == EWOULDBLOCK \
+			  || errno == EINPROGRESS)
+
+/* Accept a connection for the first queued port. Connections without a port
+   wait in the listen backlog (see net_backlog), so an accept is only
+   submitted while ports are queued. */
+void accept_arm (Acceptor *a) { struct io_uring_sqe *sqe;
+  if (a->armed || a->pe.socket < 0 || queue_empty (&a->ports)) return;
+  sqe = ring_sqe (&_reactor->ring); a->armed = 1;
+  sqe->opcode = IORING_OP_ACCEPT; sqe->fd = a->pe.socket;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = ring_data (a, 0, OP_ACCEPT);
+}
+
+Acceptor *net_listen (Address *address) {
+  Acceptor *a = type_alloc (Acceptor);
+  a->pe.type = TCP_ACCEPTOR;
+  a->pe.socket = bsd_listen (address);
+  non_block_enable (a->pe.socket);
+  return a;
+}
+
+void recv_arm (TcpPort *p) {
+  struct io_uring_sqe *sqe = ring_sqe (&_reactor->ring);
+  sqe->opcode = IORING_OP_RECV; sqe->fd = p->pe.socket;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT; sqe->buf_group = 0;
+  sqe->user_data = ring_data (p, p->gen, OP_RECV);
+  p->recv = 1;
+}
+
+void send_submit (TcpPort *p) {
+  struct io_uring_sqe *sqe = ring_sqe (&_reactor->ring);
+  p->flight = p->length - p->sent;
+  sqe->opcode = IORING_OP_SEND; sqe->fd = p->pe.socket;
+  sqe->addr = (uint64_t)(p->send + p->sent); sqe->len = p->flight;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = ring_data (p, p->gen, OP_SEND);
+}
+
+// reset the port for a new connection
+void port_reset (TcpPort *p, int socket) {
+  p->pe.socket = socket; p->pe.end = 0;
+  p->rx_head = p->rx_tail = 0;
+  p->recv = p->eof = p->blocked = 0;
+  p->length = p->sent = p->flight = 0;
+}
+
+void port_open (TcpPort *p, int socket) {
+  port_reset (p, socket);
+  p->pe.status = Connected; recv_arm (p);
+}
+
+void net_accept (void *port, Acceptor *a) {
+  TcpPort *p = port;
+  p->pe.next = NULL; queue_add (&a->ports, p);
+  accept_arm (a);
+}
+
+/* Without descriptors (EMFILE, ENFILE) the accept would fail again at once,
+   the Acceptor tries again after a delay. */
+int accept_complete (Acceptor *a, int res, void **any) {
+  TcpPort *p; a->armed = 0;
+  if (res == -ECANCELED || res == -EBADF) return 0; // closed
+  if (res == -EMFILE || res == -ENFILE || res == -ENOBUFS || res == -ENOMEM) {
+    a->retry.data = a; a->retry.type = TCP_ACCEPTOR;
+    wheel_set (&_reactor->wheel, &a->retry, clock_ms () + ACCEPT_RETRY);
+    return 0;
+  }
+  if (res >= 0) {
+    p = queue_remove (&a->ports); port_open (p, res);
+    p->pe.type = TCP_PORT; *any = _reactor->prev = &p->pe;
+  } accept_arm (a);
+  return res >= 0? TCP_ACCEPT : 0;
+}
+
+int net_status (void *port) {
+  TcpPort *p = port; return p->pe.status;
+}
+
+int _tcp_timeout = 10;
+
+void net_timeout (int seconds) {
+  _tcp_timeout = seconds;
+}
+
+void set_timeout (void *port) {
+  TcpPort *p = port;
+  p->timeout.data = p; p->timeout.type = TCP_TIMEOUT;
+  wheel_set (&_reactor->wheel, &p->timeout, clock_ms () + _tcp_timeout * 1000);
+}
+
+void clear_timeout (void *port) {
+  TcpPort *p = port;
+  wheel_cancel (&_reactor->wheel, &p->timeout);
+}
+
+// cancel any operations on the socket, then close it
+void socket_close (int fd) {
+  struct io_uring_sqe *sqe = ring_sqe (&_reactor->ring);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL; sqe->fd = fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->flags = IOSQE_IO_HARDLINK;
+  sqe->user_data = ring_data (NULL, 0, OP_CANCEL);
+  sqe = ring_sqe (&_reactor->ring);
+  sqe->opcode = IORING_OP_CLOSE; sqe->fd = fd;
+  sqe->user_data = ring_data (NULL, 0, OP_CANCEL);
+}
+
+// return the received buffers to the kernel
+void rx_release (TcpPort *p) {
+  Reactor *r = _reactor; int id;
+  while (p->rx_head) {
+    id = p->rx_head-1; p->rx_head = r->rx[id].next;
+    buffer_recycle (r, id);
+  } p->rx_tail = 0;
+}
+
+#include "../linux/race.c"
+
+// attempts complete with OP_ATTEMPT, a closed attempt's connect is cancelled
+int attempt_start (Attempt *a) { struct io_uring_sqe *sqe;
+  if ((a->pe.socket = bsd_socket (a->addr.family)) < 0) return 0;
+  non_block_enable (a->pe.socket);
+  sqe = ring_sqe (&_reactor->ring);
+  sqe->opcode = IORING_OP_CONNECT; sqe->fd = a->pe.socket;
+  sqe->addr = (uint64_t)&a->addr; sqe->off = a->addr.length;
+  sqe->user_data = ring_data (a, a->port->gen, OP_ATTEMPT);
+  return 1;
+}
+
+void attempt_close (Attempt *a) {
+  socket_close (a->pe.socket); a->pe.socket = -1;
+}
+
+void port_adopt (TcpPort *p, int socket, Address *addr) {
+  port_reset (p, socket); address_copy (&p->addr, addr);
+  clear_timeout (p);
+  p->pe.status = Connected; p->pe.type = TCP_PORT;
+  recv_arm (p);
+}
+
+int attempt_complete (Attempt *a, int gen, int res, void **any) {
+  if (a->pe.socket < 0 || gen != (a->port->gen & 0x1fff)) return 0;
+  if (res < 0) { race_failed (a); return 0; }
+  *any = _reactor->prev = &race_won (a)->pe; return TCP_CONNECT;
+}
+
+void net_close (void *port) {
+  PollEvent *pe = port; TcpPort *p = port;
+  switch (pe->type) {
+  case TCP_CONNECT:
+  case TCP_PORT:
+    if (p->race) race_end (p->race);
+    pe->status = Closed;
+    pe->type = TCP_CLOSED;
+    pe->end = 1;
+    if (pe->socket >= 0) socket_close (pe->socket);
+    rx_release (p); p->gen++;
+    port_reset (p, -1);
+    clear_timeout (pe);
+    queue_add (&_reactor->active, pe);
+    break;
+  case TCP_ACCEPTOR:
+    wheel_cancel (&_reactor->wheel, &((Acceptor *)pe)->retry);
+    socket_close (pe->socket); pe->socket = -1;
+  }
+}
+
+void net_connect (void *port, Address *server) {
+  TcpPort *p = port; struct io_uring_sqe *sqe;
+  port_reset (p, bsd_socket (server->family));
+  non_block_enable (p->pe.socket);
+  p->pe.type = TCP_CONNECT; p->pe.status = InProgress;
+  address_copy (&p->addr, server);
+  sqe = ring_sqe (&_reactor->ring);
+  sqe->opcode = IORING_OP_CONNECT; sqe->fd = p->pe.socket;
+  sqe->addr = (uint64_t)&p->addr; sqe->off = server->length;
+  sqe->user_data = ring_data (p, p->gen, OP_CONNECT);
+  set_timeout (p);
+}
+
+void net_connect_any (void *port, Address *addrs, int n) {
+  TcpPort *p = port;
+  if (n == 1) { net_connect (port, addrs); return; }
+  race_init (p, addrs, n); port_reset (p, -1);
+  p->pe.type = TCP_CONNECT; p->pe.status = InProgress;
+  set_timeout (p); race_next (p->race);
+}
+
+int tcp_connected (TcpPort *p, int res, void **any) {
+  if (res < 0) {
+    net_close (p); return 0;
+  }
+  clear_timeout (p);
+  p->pe.status = Connected; p->pe.type = TCP_PORT;
+  recv_arm (p);
+  *any = _reactor->prev = &p->pe; return TCP_CONNECT;
+}
+
+// signal a TcpPort with data to be read, or the end of the stream
+int tcp_signal (TcpPort *p, void **any) {
+  clear_timeout (p); p->pe.end = 0;
+  *any = _reactor->prev = &p->pe; return TCP_PORT;
+}
+
+int tcp_received (TcpPort *p, int res, int id, int more, void **any) {
+  Reactor *r = _reactor; int empty = !p->rx_head;
+  if (res > 0) {
+    RxChunk *c = &r->rx[id];
+    c->next = 0; c->offset = 0; c->length = res;
+    if (p->rx_tail) r->rx[p->rx_tail-1].next = id+1;
+    else p->rx_head = id+1;
+    p->rx_tail = id+1;
+  } else if (res == -ENOBUFS) {
+    if (!p->starving) {
+      p->starved = r->starved; r->starved = p; p->starving = 1;
+    }
+  } else p->eof = 1;
+  if (!more) {
+    p->recv = 0;
+    if (res > 0) recv_arm (p);
+  }
+  return empty && (res > 0 || p->eof)? tcp_signal (p, any) : 0;
+}
+
+// re-arm the ports that ran out of receive buffers
+void recv_starved (Reactor *r) {
+  TcpPort *p;
+  while (p = r->starved) {
+    r->starved = p->starved; p->starving = 0;
+    if (p->pe.status == Connected && !p->recv && !p->eof) recv_arm (p);
+  }
+}
+
+// return the send buffer to the pool, a larger buffer is freed
+void send_release (TcpPort *p) {
+  if (p->size == SEND_SIZE) pool_put (&_reactor->sends, p->send);
+  else free (p->send);
+  p->send = NULL; p->size = 0;
+}
+
+int tcp_sent (TcpPort *p, int res, void **any) {
+  p->flight = 0;
+  if (res < 0) {
+    p->length = p->sent = 0; p->eof = 1; send_release (p);
+    return p->rx_head? 0 : tcp_signal (p, any);
+  }
+  if ((p->sent += res) < p->length) {
+    send_submit (p); return 0;
+  }
+  p->length = p->sent = 0; send_release (p);
+  if (p->blocked) {
+    p->blocked = 0; *any = &p->pe; return TCP_WRITABLE;
+  } return 0;
+}
+
+int net_read (void *port, char *buffer, int size) {
+  TcpPort *p = port; Reactor *r = _reactor; RxChunk *c; int n = 0, k, id;
+  if (p->pe.status != Connected) {
+    p->pe.end = 1; return -1;
+  }
+  while (p->rx_head && n < size) {
+    id = p->rx_head-1; c = &r->rx[id];
+    k = min (c->length, size - n);
+    memcpy (buffer+n, r->buffers + id * RX_SIZE + c->offset, k);
+    n += k; c->offset += k; c->length -= k;
+    if (!c->length) {
+      if (!(p->rx_head = c->next)) p->rx_tail = 0;
+      buffer_recycle (r, id);
+    }
+  } p->pe.end = !p->rx_head && !p->eof;
+  if (n) return n;
+  if (p->eof) {
+    net_close (p); return 0;
+  } errno = EAGAIN; return -1;
+}
+
+/* Data is copied to the send buffer and submitted, the write either
+   completes or fails with EAGAIN if the buffer is full while a send is in
+   progress, in which case a TCP_WRITABLE event is returned when the buffer
+   is sent. */
+int net_writev (void *port, const struct iovec *iov, int n) {
+  TcpPort *p = port; int i, length = 0;
+  if (p->pe.status != Connected) return -1;
+  for (i = 0; i < n; i++) length += iov[i].iov_len;
+  if (p->flight) {
+    if (p->length + length > p->size) {
+      p->blocked = 1; errno = EAGAIN; return -1;
+    }
+  } else if (!p->send || length > p->size) {
+    if (p->send) send_release (p);
+    if (length > SEND_SIZE) p->send = malloc (p->size = length);
+    else { p->send = pool_get (&_reactor->sends); p->size = SEND_SIZE; }
+  }
+  for (i = 0; i < n; i++) {
+    memcpy (p->send + p->length, iov[i].iov_base, iov[i].iov_len);
+    p->length += iov[i].iov_len;
+  }
+  if (!p->flight) send_submit (p);
+  return length;
+}
+
+int net_write (void *port, const char *data, int length) {
+  struct iovec iov = {(void *)data, length};
+  return net_writev (port, &iov, 1);
+}
+
+Address *net_remote (Address *addr, void *port) {
+  TcpPort *p = port; addr->length = sizeof (Address);
+  getpeername (p->pe.socket, (struct sockaddr *)addr, &addr->length);
+  return addr;
+}
+
+Address *net_local (Address *addr, void *port) {
+  TcpPort *p = port; addr->length = sizeof (Address);
+  getsockname (p->pe.socket, (struct sockaddr*)addr, &addr->length);
+  return addr;
+}
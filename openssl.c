@@ -20,7 +20,12 @@ typedef int (*VerifyFunc) (void *context, uint8_t *cert, int length);
     Certificates are in any case are verified against their CA certificate
     chain, this extra step this can be used to impliment a filter by only
     accepting clients with the right credentials (SFDI, LFDI), this parameter
-    can be NULL to indicate not to take this step.
+    can be NULL to indicate not to take this step. With handshake workers
+    (see @ref tls_workers) the function is called from the worker threads,
+    concurrently for different connections, so it must be thread safe. The
+    connection passed as the context is then owned by its Reactor, which
+    may close and reuse it while the worker runs, the function should only
+    use it to identify the connection.
     @returns the path of the device certificate 'path'.x509
 */
 void tls_init (const char *path, VerifyFunc verify);
@@ -41,6 +46,45 @@ void load_cert (const char *path);
 */
 void load_cert_dir (const char *path);
 
+/** @brief Set the size and lifetime of the client session cache.
+
+    Client connections keep the TLS session from a server by the server
+    address and resume it when connecting to the same address again, this
+    avoids the certificate exchange and signatures of a full handshake. The
+    cache is shared by the threads, when full the oldest session is replaced.
+    @param size is the number of sessions kept (at most 256, default 32), 0
+    disables session resumption
+    @param lifetime is the time in seconds a session is kept (default 7200),
+    or less if the server gives a shorter lifetime
+*/
+void tls_session_cache (int size, int lifetime);
+
+/** @brief Run TLS handshakes on worker threads.
+
+    Start threads that run the CPU heavy steps of TLS handshakes (key
+    exchange, signatures and certificate verification) for the connections of
+    every Reactor, so that many handshakes at once do not stall the event
+    loop. The Reactor only reads and writes the handshake records, when a
+    step completes a TCP_PORT event is posted for the Connection and
+    @ref conn_session continues the handshake. The verify function given to
+    @ref tls_init runs on the worker threads.
+    @param n is the number of worker threads to start
+*/
+void tls_workers (int n);
+
+/** @brief Set the size of the verified certificate cache.
+
+    The result of checking a peer certificate (the certificate extensions and
+    the verify function given to @ref tls_init) is kept with the LFDI of the
+    certificate, a handshake with a peer seen before then takes the result
+    from the cache. The verify function is called once for a certificate and
+    should depend on the certificate only. Loading a CA certificate clears the
+    cache, when full the least recently used certificate is replaced.
+    @param size is the number of certificates kept (at most 256, default 64),
+    0 disables the cache
+*/
+void tls_verify_cache (int size);
+
 /** @} */
 
 #ifndef HEADER_ONLY
@@ -61,25 +105,66 @@ void print_ssl_error (char *func) {
 
 SSL_CTX *ssl_ctx = NULL;
 
+/* Handshake workers. The Reactor reads the records from the peer into the
+   Handshake and queues it, a worker runs the handshake step with the BIO of
+   the SSL reading and writing the Handshake buffers instead of the socket,
+   then posts a TCP_PORT event for the Connection to the Reactor, which writes
+   the records produced by the step. The SSL belongs to the worker while the
+   step runs, a Connection closed meanwhile releases it to the worker. */
+
+enum HandshakeState {HANDSHAKE_RUNNING = 1, HANDSHAKE_DONE = 2,
+		     HANDSHAKE_RELEASED = 4};
+
+typedef struct _Handshake {
+  struct _Handshake *next;
+  SSL *ssl; void *conn;
+  Address peer; // the connection may be closed while a worker runs a step
+  Reactor *reactor; // posted the completion
+  BIO *in, *out; // records from the peer, records to the peer
+  int ret, err;
+  int state; // HandshakeState bits, updated atomically
+} Handshake;
+
+int _handshake_workers = 0;
+pthread_mutex_t _handshake_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t _handshake_queued = PTHREAD_COND_INITIALIZER;
+Queue _handshakes = {NULL, NULL};
+__thread Handshake *_handshake = NULL; // the step run by a worker
+
 int bio_read (BIO *bio, char *buffer, int size) {
-  TcpPort *p = BIO_get_data (bio);
-  int n = net_read (p, buffer, size);
-  // printf ("ssl_read %d, %d\n", size, n); fflush (stdout);
+  TcpPort *p = BIO_get_data (bio); BIO *rest; int n;
   BIO_clear_retry_flags (bio);
+  if (_handshake) {
+    if ((n = BIO_read (_handshake->in, buffer, size)) <= 0)
+      BIO_set_retry_read (bio);
+    return n;
+  }
+  if (rest = BIO_get_app_data (bio)) { // read past the handshake by the Reactor
+    n = BIO_read (rest, buffer, size);
+    if (!BIO_pending (rest)) { BIO_free (rest); BIO_set_app_data (bio, NULL); }
+    return n;
+  }
+  n = net_read (p, buffer, size);
+  // printf ("ssl_read %d, %d\n", size, n); fflush (stdout);
   if (n == -1 && event_pending (p))
       BIO_set_retry_read (bio);
   return n;
 }
 
 int bio_write (BIO *bio, const char *buffer, int size) {
-  TcpPort *p = BIO_get_data (bio);
-  int n = net_write (p, buffer, size);
+  TcpPort *p = BIO_get_data (bio); int n;
+  if (_handshake) return BIO_write (_handshake->out, buffer, size);
+  n = net_write (p, buffer, size);
   BIO_clear_retry_flags (bio);
   if (n == -1 && event_pending (p))
     BIO_set_retry_write (bio);
   return n;
 }
 
+int bio_destroy (BIO *bio) {
+  BIO_free (BIO_get_app_data (bio)); return 1;
+}
+
 long bio_ctrl (BIO *bio, int cmd, long larg, void *parg) {
   // printf ("ssl_crtl: %d\n", cmd); fflush (stdout);
   if (cmd == BIO_CTRL_FLUSH) return 1;
@@ -94,6 +179,7 @@ void init_bio () {
   BIO_meth_set_read (ssl_bio, bio_read);
   BIO_meth_set_write (ssl_bio, bio_write);
   BIO_meth_set_ctrl (ssl_bio, bio_ctrl);
+  BIO_meth_set_destroy (ssl_bio, bio_destroy);
 }
 
 typedef int (*VerifyFunc) (void *ctx, uint8_t *cert, int length);
@@ -125,21 +211,102 @@ int check_cert (int status, X509 *cert) {
   } return status;
 }
 
+/* Verified peer certificates, the result of the certificate checks and the
+   verify function, and the LFDI of the certificate, so that reconnecting to
+   the same peers does not encode and hash the certificate again. Entries are
+   matched with X509_cmp (the SHA-1 fingerprint OpenSSL keeps for a parsed
+   certificate, then the encoding), the least recently used entry is
+   replaced when the cache is full. Loading a CA certificate clears the
+   cache. */
+
+#define VERIFIED_MAX 256
+
+typedef struct {
+  X509 *cert; // NULL when unused
+  uint8_t lfdi[20];
+  int status; // 1 accepted, 0 rejected
+  uint64_t used;
+} VerifiedCert;
+
+VerifiedCert _verified[VERIFIED_MAX];
+int _verified_limit = 64; uint64_t _verified_clock = 0;
+pthread_mutex_t _verified_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void verified_clear (int from) { int i;
+  pthread_mutex_lock (&_verified_lock);
+  for (i = max (from, 0); i < VERIFIED_MAX; i++)
+    if (_verified[i].cert) {
+      X509_free (_verified[i].cert); _verified[i].cert = NULL;
+    }
+  pthread_mutex_unlock (&_verified_lock);
+}
+
+void tls_verify_cache (int size) {
+  _verified_limit = min (size, VERIFIED_MAX); verified_clear (_verified_limit);
+}
+
+// find the certificate, copy the entry, returns 1 if found
+int verified_find (X509 *cert, VerifiedCert *v) { VerifiedCert *e; int i;
+  pthread_mutex_lock (&_verified_lock);
+  for (i = 0; i < _verified_limit; i++) { e = &_verified[i];
+    if (e->cert && !X509_cmp (e->cert, cert)) {
+      e->used = ++_verified_clock; *v = *e;
+      pthread_mutex_unlock (&_verified_lock); return 1;
+    }
+  } pthread_mutex_unlock (&_verified_lock); return 0;
+}
+
+void verified_insert (VerifiedCert *v) { VerifiedCert *e = NULL; int i;
+  pthread_mutex_lock (&_verified_lock);
+  for (i = 0; i < _verified_limit; i++) {
+    if (!_verified[i].cert) { e = &_verified[i]; break; }
+    if (!e || _verified[i].used < e->used) e = &_verified[i];
+  }
+  if (e) {
+    if (e->cert) X509_free (e->cert);
+    X509_up_ref (v->cert); *e = *v; e->used = ++_verified_clock;
+  } pthread_mutex_unlock (&_verified_lock);
+}
+
+// DER encoded certificate in a buffer with room for sha256 padding
+uint8_t *cert_der (X509 *cert, int *length) { uint8_t *der, *p;
+  *length = i2d_X509 (cert, NULL);
+  der = p = malloc (sha256_size (*length));
+  i2d_X509 (cert, &p); return der;
+}
+
+// check a peer certificate, the result is kept in the cache
+VerifiedCert *verify_cert (VerifiedCert *v, X509 *cert, void *user) {
+  int length; uint8_t *der;
+  if (verified_find (cert, v)) return v;
+  der = cert_der (cert, &length); v->cert = cert;
+  v->status = check_cert (1, cert)
+    && (!_verify_peer || _verify_peer (user, der, length));
+  lfdi_hash (v->lfdi, der, length); free (der);
+  verified_insert (v); return v;
+}
+
 int verify_peer (int status, X509_STORE_CTX *ctx) {
   SSL *ssl = X509_STORE_CTX_get_ex_data
     (ctx, SSL_get_ex_data_X509_STORE_CTX_idx ());
-  void *user = SSL_get_app_data (ssl);
-  X509 *x509 = X509_STORE_CTX_get0_cert (ctx), // peer cert
-    *curr = X509_STORE_CTX_get_current_cert (ctx);
-  status = check_cert (status, x509);
-  if (x509 != curr) return status; // only check the peer cert
-  if (x509 && _verify_peer) {
-    int length = i2d_X509 (x509, NULL);
-    uint8_t *cert, *p = malloc (sha256_size (length)); cert = p;
-    i2d_X509 (x509, &p);
-    if (!_verify_peer (user, cert, length)) status = 0;
-    free (cert);
-  } return status;
+  void *user = SSL_get_app_data (ssl); VerifiedCert v;
+  X509 *x509 = X509_STORE_CTX_get0_cert (ctx); // peer cert
+  // only check the peer cert, at depth 0 the current cert can be the copy
+  // of a self-signed peer cert from the trust store
+  if (X509_STORE_CTX_get_error_depth (ctx)) return status;
+  return x509 && status? verify_cert (&v, x509, user)->status : status;
+}
+
+// the LFDI of the peer certificate, returns 1 if the peer has a certificate
+int ssl_peer_lfdi (void *ssl, uint8_t *lfdi) {
+  X509 *cert = SSL_get0_peer_certificate (ssl); VerifiedCert v;
+  uint8_t *der; int length;
+  if (!cert) return 0;
+  if (verified_find (cert, &v)) memcpy (lfdi, v.lfdi, 20);
+  else { // not kept, the cache is disabled or full
+    der = cert_der (cert, &length);
+    lfdi_hash (lfdi, der, length); free (der);
+  } return 1;
 }
 
 const uint8_t *ssl_session_id (void *ssl) {
@@ -147,7 +314,88 @@ const uint8_t *ssl_session_id (void *ssl) {
   return SSL_SESSION_get0_id_context (ss, NULL);
 }
 
+#define SESSION_CACHE_MAX 256
+
+typedef struct {
+  Address addr; // server address
+  SSL_SESSION *session; // NULL when unused
+  uint64_t expires;
+} CachedSession;
+
+CachedSession _sessions[SESSION_CACHE_MAX];
+int _session_limit = 32, _session_lifetime = 7200;
+pthread_mutex_t _session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void session_drop (CachedSession *s) {
+  SSL_SESSION_free (s->session); s->session = NULL;
+}
+
+void tls_session_cache (int size, int lifetime) { int i;
+  pthread_mutex_lock (&_session_lock);
+  _session_limit = min (size, SESSION_CACHE_MAX);
+  _session_lifetime = lifetime;
+  for (i = max (_session_limit, 0); i < SESSION_CACHE_MAX; i++)
+    if (_sessions[i].session) session_drop (&_sessions[i]);
+  pthread_mutex_unlock (&_session_lock);
+}
+
+CachedSession *session_find (Address *addr) { int i;
+  for (i = 0; i < _session_limit; i++)
+    if (_sessions[i].session && address_eq (&_sessions[i].addr, addr))
+      return &_sessions[i];
+  return NULL;
+}
+
+/* the server address, zeroed so addresses compare with address_eq, a worker
+   uses the address recorded in the Handshake */
+Address *ssl_peer (Address *addr, SSL *ssl) {
+  if (_handshake) return address_copy (addr, &_handshake->peer);
+  memset (addr, 0, sizeof (Address));
+  return net_remote (addr, SSL_get_app_data (ssl));
+}
+
+/* new session callback, keeps a session from the server (a TLS 1.3 ticket
+   arrives after the handshake), returns 1 to keep the reference */
+int session_new (SSL *ssl, SSL_SESSION *session) {
+  CachedSession *s, *oldest = _sessions; Address addr; int i, lifetime;
+  if (SSL_is_server (ssl) || !_session_limit) return 0;
+  ssl_peer (&addr, ssl); pthread_mutex_lock (&_session_lock);
+  if (!(s = session_find (&addr))) {
+    for (i = 0; i < _session_limit; i++) { s = &_sessions[i];
+      if (!s->session) break;
+      if (s->expires < oldest->expires) oldest = s;
+    } if (i == _session_limit) s = oldest;
+  }
+  if (s->session) SSL_SESSION_free (s->session);
+  lifetime = SSL_SESSION_get_timeout (session);
+  lifetime = min (lifetime, _session_lifetime);
+  address_copy (&s->addr, &addr); s->session = session;
+  s->expires = clock_ms () + lifetime * 1000;
+  pthread_mutex_unlock (&_session_lock); return 1;
+}
+
+// offer the cached session for the server before a client handshake starts
+void ssl_resume (SSL *ssl) { CachedSession *s; Address addr;
+  if (SSL_is_server (ssl) || !SSL_in_before (ssl)) return;
+  ssl_peer (&addr, ssl); pthread_mutex_lock (&_session_lock);
+  if (s = session_find (&addr)) {
+    if (s->expires > clock_ms () && SSL_SESSION_is_resumable (s->session))
+      SSL_set_session (ssl, s->session);
+    else session_drop (s);
+  } pthread_mutex_unlock (&_session_lock);
+}
+
+// a failed handshake forgets the session, the next one is a full handshake
+void ssl_forget (SSL *ssl) { CachedSession *s; Address addr;
+  if (SSL_is_server (ssl)) return;
+  ssl_peer (&addr, ssl); pthread_mutex_lock (&_session_lock);
+  if (s = session_find (&addr)) session_drop (s);
+  pthread_mutex_unlock (&_session_lock);
+}
+
+// a new trust anchor may change the result of the verify function
 int ssl_load_cert (const char *path) {
+  verified_clear (0);
   return SSL_CTX_load_verify_locations (ssl_ctx, path, NULL);
 }
 
@@ -174,6 +422,14 @@ void tls_init (const char *path, VerifyFunc verify) {
     print_ssl_error ("tls_init"); exit (0);
   }
   init_bio (); _verify_peer = verify;
+  // writes that would block are retried from the HttpConnection send queue
+  SSL_CTX_set_mode (ssl_ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  // client sessions are kept in the session cache above, servers resume
+  // sessions from tickets (the id context is required with peer verification)
+  SSL_CTX_set_session_cache_mode (ssl_ctx, SSL_SESS_CACHE_CLIENT |
+				  SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb (ssl_ctx, session_new);
+  SSL_CTX_set_session_id_context (ssl_ctx, (const uint8_t *)"se", 2);
   SSL_CTX_set_verify (ssl_ctx, SSL_VERIFY_PEER |
 		      SSL_VERIFY_FAIL_IF_NO_PEER_CERT, verify_peer);
   if (!SSL_CTX_set_cipher_list (ssl_ctx, CIPHER_LIST)) {
@@ -209,27 +465,120 @@ void *ssl_new (void *conn) {
 
 #define ssl_free(ssl) SSL_free (ssl)
 #define ssl_close(ssl) SSL_shutdown (ssl)
+#define ssl_resumed(ssl) SSL_session_reused (ssl)
 
-int ssl_ret, ssl_err;
+// SSL_ERROR_WANT_ASYNC while a handshake step runs on a worker
+#define ssl_pending(err) \
+  ((err) == SSL_ERROR_WANT_READ || (err) == SSL_ERROR_WANT_WRITE \
+   || (err) == SSL_ERROR_WANT_ASYNC)
 
-#define ssl_pending() \
-  (ssl_err == SSL_ERROR_WANT_READ || ssl_err == SSL_ERROR_WANT_WRITE)
+void handshake_free (Handshake *h) {
+  BIO_free (h->in); BIO_free (h->out); free (h);
+}
+
+void *handshake_worker (void *arg) { Handshake *h; int state;
+  while (1) {
+    pthread_mutex_lock (&_handshake_lock);
+    while (!(h = queue_remove (&_handshakes)))
+      pthread_cond_wait (&_handshake_queued, &_handshake_lock);
+    pthread_mutex_unlock (&_handshake_lock);
+    _handshake = h; ERR_clear_error ();
+    if ((h->ret = SSL_do_handshake (h->ssl)) != 1) {
+      h->err = SSL_get_error (h->ssl, h->ret);
+      if (!ssl_pending (h->err)) print_ssl_error ("tls_session");
+    } _handshake = NULL;
+    state = __atomic_fetch_or (&h->state, HANDSHAKE_DONE, __ATOMIC_ACQ_REL);
+    if (state & HANDSHAKE_RELEASED) { SSL_free (h->ssl); handshake_free (h); }
+    else reactor_post (h->reactor, h->conn, TCP_PORT);
+  } return NULL;
+}
+
+void tls_workers (int n) { pthread_t t;
+  while (n-- > 0)
+    if (!pthread_create (&t, NULL, handshake_worker, NULL)) {
+      pthread_detach (t); _handshake_workers++;
+    }
+}
+
+// discard n bytes written by a handshake step
+void records_sent (BIO *out, int n) { char buffer[1024];
+  while (n > 0) n -= BIO_read (out, buffer, min (n, sizeof (buffer)));
+}
+
+/* a handshake step on a worker, write the records of the completed step and
+   read the records from the peer, queue the next step if there are any */
+int ssl_offload (SSL *ssl, Handshake **job, int *err) {
+  Handshake *h = *job; TcpPort *p = SSL_get_app_data (ssl);
+  char buffer[4096], *data; int n;
+  if (!h) {
+    h = *job = calloc (1, sizeof (Handshake));
+    h->ssl = ssl; h->conn = p; ssl_peer (&h->peer, ssl);
+    h->in = BIO_new (BIO_s_mem ()); h->out = BIO_new (BIO_s_mem ());
+  } else if (h->state) {
+    if (!(__atomic_load_n (&h->state, __ATOMIC_ACQUIRE) & HANDSHAKE_DONE)) {
+      *err = SSL_ERROR_WANT_ASYNC; return 0;
+    } h->state = 0;
+    if (h->ret != 1 && !ssl_pending (h->err)) goto failed;
+  }
+  while ((n = BIO_get_mem_data (h->out, &data)) > 0) {
+    if ((n = net_write (p, data, n)) <= 0) {
+      if (n < 0 && event_pending (p)) { *err = SSL_ERROR_WANT_WRITE; return 0; }
+      goto closed;
+    } records_sent (h->out, n);
+  }
+  if (h->ret == 1) { // the SSL reads any records that follow the handshake
+    if (BIO_pending (h->in)) {
+      BIO_set_app_data (SSL_get_rbio (ssl), h->in); h->in = NULL;
+    } handshake_free (h); *job = NULL; return 1;
+  }
+  while ((n = net_read (p, buffer, sizeof (buffer))) > 0)
+    BIO_write (h->in, buffer, n);
+  if (n == 0) goto closed;
+  if (!BIO_pending (h->in) && !(SSL_in_before (ssl) && !SSL_is_server (ssl))) {
+    *err = SSL_ERROR_WANT_READ; return 0;
+  }
+  ssl_resume (ssl); h->reactor = reactor_current ();
+  h->state = HANDSHAKE_RUNNING; h->next = NULL;
+  pthread_mutex_lock (&_handshake_lock);
+  queue_add (&_handshakes, h);
+  pthread_cond_signal (&_handshake_queued);
+  pthread_mutex_unlock (&_handshake_lock);
+  *err = SSL_ERROR_WANT_ASYNC; return 0;
+ closed: h->err = SSL_ERROR_SYSCALL;
+ failed: *err = h->err; ssl_forget (ssl);
+  handshake_free (h); *job = NULL; return 0;
+}
+
+/* release the handshake step of a closed connection, returns 1 if a worker
+   runs the step, the worker then frees the SSL */
+int ssl_release (void *ssl, void **job) { Handshake *h = *job; int state;
+  if (!h) return 0; *job = NULL;
+  state = __atomic_fetch_or (&h->state, HANDSHAKE_RELEASED, __ATOMIC_ACQ_REL);
+  if (state == HANDSHAKE_RUNNING) return 1;
+  handshake_free (h); return 0;
+}
 
-int ssl_handshake (void *ssl) { ERR_clear_error ();
-  if ((ssl_ret = SSL_do_handshake (ssl)) == 1) return 1;
-  ssl_err = SSL_get_error (ssl, ssl_ret);
+/* continue the handshake, on a worker if there are handshake workers,
+   returns 1 when the handshake completes, otherwise 0 with the error */
+int ssl_handshake (void *ssl, void **job, int *err) { int ret;
+  if (_handshake_workers || *job)
+    return ssl_offload (ssl, (Handshake **)job, err);
+  ERR_clear_error (); ssl_resume (ssl);
+  if ((ret = SSL_do_handshake (ssl)) == 1) return 1;
+  *err = SSL_get_error (ssl, ret);
+  if (!ssl_pending (*err)) ssl_forget (ssl);
   return 0;
 }
 
-int ssl_read (void *ssl, char *buffer, int size) { int ret;
+int ssl_read (void *ssl, char *buffer, int size, int *err) { int ret;
   ERR_clear_error (); ret = SSL_read (ssl, buffer, size);
-  if (ret <= 0) ssl_err = SSL_get_error (ssl, ret); 
+  if (ret <= 0) *err = SSL_get_error (ssl, ret); 
   return ret;
 }
 
-int ssl_write (void *ssl, const char *data, int length) { int ret;
+int ssl_write (void *ssl, const char *data, int length, int *err) { int ret;
   ERR_clear_error (); ret = SSL_write (ssl, data, length);
-  if (ret <= 0) ssl_err = SSL_get_error (ssl, ret);
+  if (ret <= 0) *err = SSL_get_error (ssl, ret);
   return ret;
 }
 
@@ -37,6 +37,7 @@ enum EventType {
   TCP_TIMEOUT, ///< A TcpPort that timed out
   TIMER_EVENT, ///< A timer that expired.
   POLL_TIMEOUT, ///< The event_poll function timed out waiting for an event.
+  TCP_WRITABLE, ///< A TcpPort that can be written to after a write blocked.
   EVENT_NEW=32 ///< A place holder for higher level events.
 };
 
@@ -51,6 +52,168 @@ enum EventType {
 */
 int event_poll (void **any, int timeout);
 
+/** @brief Have event_poll return the object again.
+
+    A TcpPort is returned by event_poll (TCP_PORT) until a read would block.
+    Use event_again to have the TcpPort returned once more after its data has
+    been read, so the application can release resources held for a message
+    when no more data is available.
+    @param any is a pointer to the object
+*/
+void event_again (void *any);
+
+/** @} */
+
+/** @defgroup event_stats Event Statistics
+
+    Optional instrumentation of the event loop. Once enabled for a thread,
+    the time taken to handle each event is recorded by event type, the
+    handling time is from when @ref event_poll (or @ref next_event) returns
+    the event until either is called again. The depth of the Reactor queue of
+    objects with pending events and of the immediate event queue (see
+    @ref insert_event) are sampled on each call.
+    @{
+*/
+
+#define EVENT_TYPES 64 ///< event types recorded, larger types share the last
+#define EVENT_BUCKETS 24 ///< histogram buckets
+
+/** @brief Handling time statistics for an event type */
+typedef struct {
+  uint64_t count; ///< is the number of events handled
+  uint64_t total; ///< is the total handling time in microseconds
+  uint64_t max; ///< is the maximum handling time in microseconds
+  /** bucket i counts handling times less than 2^i microseconds, the last
+      bucket counts all larger times */
+  uint32_t histogram[EVENT_BUCKETS];
+} EventStats;
+
+/** @brief Queue depth statistics */
+typedef struct {
+  uint64_t samples; ///< is the number of samples
+  uint64_t total; ///< is the sum of the sampled depths
+  int max; ///< is the maximum depth
+} DepthStats;
+
+/** @brief Event loop statistics for a thread */
+typedef struct {
+  EventStats type[EVENT_TYPES]; ///< statistics indexed by event type
+  DepthStats active; ///< Reactor queue of objects with pending events
+  DepthStats queued; ///< immediate event queue
+  uint64_t stalls; ///< is the number of events that exceeded the budget
+  int budget; ///< is the time budget for handling an event in milliseconds
+} LoopStats;
+
+/** @brief Enable event loop statistics for the calling thread.
+    @param budget is the time in milliseconds allowed for handling an event,
+    a warning is printed when an event takes longer, 0 for no warnings
+    @returns a pointer to the LoopStats for the thread
+*/
+LoopStats *event_stats_enable (int budget);
+
+/** @brief Return the event loop statistics for the calling thread.
+    @returns a pointer to the LoopStats or NULL if not enabled
+*/
+LoopStats *event_stats ();
+
+/** @brief Print event loop statistics.
+    @param s is a pointer to LoopStats
+*/
+void print_event_stats (LoopStats *s);
+
+/** @brief Print event loop statistics when a signal is received.
+
+    Each thread with statistics enabled prints its statistics the next time
+    it polls for an event.
+    @param sig is the signal number (e.g. SIGUSR1)
+*/
+void event_stats_signal (int sig);
+
+/** @brief Mark the end of handling the last event and the start of the next.
+
+    Called by poll functions, @ref event_poll and @ref next_event call this
+    function so that other poll functions need only call it when they return
+    events of their own.
+    @param type is the type of the event returned, or EVENT_NONE
+*/
+void event_mark (int type);
+
+/** @brief Sample the depth of a queue.
+    @param d is a pointer to DepthStats
+    @param q is a pointer to a Queue
+*/
+void depth_sample (DepthStats *d, Queue *q);
+
+/** @} */
+
+/** @defgroup reactor Reactor
+
+    A Reactor holds the state of an event loop: the set of polled objects,
+    the queue of objects with pending events, and the timers. Each thread
+    that polls for events owns a Reactor, objects (TcpPorts, UdpPorts,
+    Acceptors, and Timers) belong to the Reactor that is current for the
+    thread when they are opened or armed and should only be used from that
+    thread. @ref platform_init creates the Reactor for the calling thread,
+    so a single threaded application only needs @ref event_poll.
+    @{
+*/
+
+typedef struct _Reactor Reactor;
+
+/** @brief Create a new Reactor.
+    @returns a pointer to a Reactor with its own event polling instance
+*/
+Reactor *reactor_new ();
+
+/** @brief Make a Reactor current for the calling thread.
+    @param r is a pointer to a Reactor
+*/
+void reactor_select (Reactor *r);
+
+/** @brief Return the current Reactor for the calling thread.
+    @returns a pointer to a Reactor or NULL if none has been selected
+*/
+Reactor *reactor_current ();
+
+/** @brief Poll an event from a Reactor.
+
+    Same as @ref event_poll, but for the Reactor given, the Reactor is made
+    current for the calling thread.
+    @param r is a pointer to a Reactor
+    @param any receives the event object pointer.
+    @param timeout is the polling timeout in milliseconds, or -1 to indicate
+    an infinite timeout.
+    @returns the @ref EventType and the associated object in the any parameter.
+*/
+int reactor_poll (Reactor *r, void **any, int timeout);
+
+/** @brief Post an event to a Reactor from any thread.
+
+    The event is returned by @ref event_poll in the thread that owns the
+    Reactor, with the type and data given, in the order posted by each
+    thread. Posting does not take a lock and wakes the Reactor if it is
+    waiting for events. Other threads use this function to hand data
+    (e.g. readings, commands, or completions) to the Reactor thread, which
+    can then use functions such as insert_event or http_write that may only
+    be called from that thread.
+    @param r is a pointer to a Reactor
+    @param data is the event object returned in the any parameter
+    @param type is the event type, e.g. EVENT_NEW+1
+*/
+void reactor_post (Reactor *r, void *data, int type);
+
+/** @brief Start a thread with its own Reactor.
+
+    The new thread creates a Reactor, makes it current, and then calls the
+    run function with the context. The run function is expected to run an
+    event loop, calling @ref event_poll.
+    @param cpu is the CPU to pin the thread to, or -1 for no pinning
+    @param run is the thread function
+    @param ctx is a pointer to a user defined context
+    @returns 1 if the thread was started, 0 otherwise
+*/
+int reactor_thread (int cpu, void (*run) (void *), void *ctx);
+
 /** @} */
 
 /** @defgroup file File
@@ -108,6 +271,12 @@ void set_timer (Timer *timer, int timeout);
 
 void set_timer_ct (Timer *timer, ClockTime *ct);
 
+/** @brief Set a Timer to expire once at a time of the monotonic clock.
+    @param timer is a pointer to the Timer
+    @param ms is the time in milliseconds (CLOCK_MONOTONIC on Linux)
+ */
+void set_timer_at (Timer *timer, uint64_t ms);
+
 /** @brief Create a new timer.
 
     When the timer expires the event type returned is the value passed to this
@@ -119,6 +288,16 @@ void set_timer_ct (Timer *timer, ClockTime *ct);
 */
 Timer *add_timer (int type);
 
+/** @brief Initialize a timer that is part of another object.
+
+    The same as @ref add_timer for a Timer that is not allocated on its own,
+    when the timer expires event_poll returns the type and the data pointer.
+    @param timer is a pointer to the Timer
+    @param type is the type to be returned by event_poll
+    @param data is the event object to be returned by event_poll
+*/
+void timer_init (Timer *timer, int type, void *data);
+
 /** @break Create a new timer, and set the timeout.
     
     This is the equivalent of calling set_timer (add_timer (type), timeout).
@@ -213,16 +392,31 @@ int net_status (void *port);
 typedef struct _Acceptor Acceptor;
 
 /** @brief Listen for connection requests on a specifc address/port.
+
+    The socket is bound with SO_REUSEPORT, so several reactors (threads) may
+    each listen on the same address/port and the connection requests are
+    distributed among them.
     @param address is the address/port on which to listen for connection
     requests
     @returns an Acceptor ready to accept connections
 */
 Acceptor *net_listen (Address *address);
 
+/** @brief Set the length of the queue of pending connection requests for
+    new Acceptors.
+    @param backlog is the maximum number of pending connections (100 by
+    default)
+*/
+void net_backlog (int backlog);
+
 /** @brief Accept a connection request and assign to a TcpPort.
 
     If there are no active requests, queue the port to receive a connection
-    at a later time.
+    at a later time. Connection requests are only accepted for queued ports,
+    requests that arrive while no port is queued wait in the listen backlog
+    (see @ref net_backlog) for the next call, so queue several ports to
+    accept a burst of requests without delay. When the process runs out of
+    file descriptors, accepting is retried after a short delay.
     @param port is a pointer to a TcpPort
     @param a is pointer to an Acceptor
 */
@@ -235,6 +429,28 @@ void net_accept (void *port, Acceptor *a);
 */
 void net_connect (void *port, Address *server);
 
+/** @brief Establish a TCP connection with the first of several host
+    addresses to respond (Happy Eyeballs, RFC 8305).
+
+    Connection attempts to the addresses are started in order, each after the
+    delay set by @ref net_attempt_delay, or at once when the previous attempt
+    fails. The first attempt to connect becomes the connection of the port
+    (TCP_CONNECT) and the others are closed. The port is closed (TCP_CLOSED)
+    if every attempt fails, the timeout (TCP_TIMEOUT) is the same as for
+    @ref net_connect.
+    @param port is a pointer to a TcpPort
+    @param addrs is an array of host addresses, up to 4 are used, list the
+    preferred address family first and alternate the families
+    @param n is the number of addresses
+*/
+void net_connect_any (void *port, Address *addrs, int n);
+
+/** @brief Set the delay between connection attempts of
+    @ref net_connect_any.
+    @param ms is the delay in milliseconds, 250 by default
+*/
+void net_attempt_delay (int ms);
+
 /** @brief Read data from a TcpPort.
     @param port is a pointer to a TcpPort
     @param buffer is a container for the data to be read
@@ -245,12 +461,30 @@ void net_connect (void *port, Address *server);
 int net_read (void *port, char *buffer, int length);
 
 /** @brief Write data to a TcpPort.
+
+    If the data cannot be written in full (a partial write or -1 with errno
+    set to EAGAIN), a TCP_WRITABLE event is returned by @ref event_poll when
+    the TcpPort can accept more data.
     @param port is a pointer to a TcpPort
     @param buffer is a container for the data to write
     @param length is the length of the data to write
+    @returns the length of the data written or -1 on failure
 */
 int net_write (void *port, const char *buffer, int length);
 
+struct iovec;
+
+/** @brief Write a vector of buffers to a TcpPort (gather write).
+
+    The same as @ref net_write, but writes the buffers in order with a
+    single system call.
+    @param port is a pointer to a TcpPort
+    @param iov is an array of buffers
+    @param n is the number of buffers
+    @returns the length of the data written or -1 on failure
+*/
+int net_writev (void *port, const struct iovec *iov, int n);
+
 /** @brief Close a TCP connection.
     @param port is a pointer to a TcpPort
 */
@@ -274,6 +508,18 @@ typedef struct _UdpPort UdpPort;
 */
 char *net_receive (UdpPort *p, int *length);
 
+/** @brief Receive a UDP datagram from a ring of datagrams received in a batch.
+
+    Same as @ref net_receive, but the datagrams waiting on the port are
+    received with one system call (recvmmsg) and returned one at a time from
+    the ring, this reduces the system calls on busy multicast ports.
+    @param p is a pointer to a UdpPort
+    @param length is updated to indicate the length of the datagram
+    @returns a pointer to the datagram, valid until the ring is refilled, or
+    NULL if no datagram is available
+*/
+char *net_receive_batch (UdpPort *p, int *length);
+
 /** @brief Send a UDP datagram to a host Address from a UdpPort. 
     @param p is a pointer to a UdpPort
     @param data is a pointer to a buffer containing the datagram
@@ -311,6 +557,10 @@ void net_join_group (UdpPort *p, const char *addr, int loop);
 
 #include "win32/platform.c"
 
+#elif defined LINUX_URING
+
+#include "linux_uring/platform.c"
+
 #else
 
 #include "linux/platform.c"
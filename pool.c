@@ -0,0 +1,65 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/** @defgroup pool Pool
+
+    A Pool keeps a free list of objects of the same size so they can be
+    borrowed while in use and returned for reuse. Pools are not locked, a
+    Pool should be declared thread local (__thread) when used by more than
+    one thread.
+    @{
+*/
+
+/** @brief Pool structure */
+typedef struct {
+  void *free; ///< is the list of free objects
+  int size; ///< is the size of the objects
+  int used; ///< is the number of objects borrowed from the pool
+  int count; ///< is the number of free objects
+} Pool;
+
+/** @brief Borrow an object from the pool.
+
+    A new object is allocated and cleared if the pool is empty, otherwise
+    the object returned keeps its contents from the last use except for the
+    first pointer sized field.
+    @param pool is a pointer to a Pool
+    @returns a pointer to the object
+*/
+void *pool_get (Pool *pool);
+
+/** @brief Return an object to the pool.
+
+    The first pointer sized field of the object is overwritten.
+    @param pool is a pointer to a Pool
+    @param item is a pointer to an object borrowed from the pool
+*/
+void pool_put (Pool *pool, void *item);
+
+/** @brief Free the objects in the pool and set the object size.
+    @param pool is a pointer to a Pool
+    @param size is the new size of the objects
+*/
+void pool_resize (Pool *pool, int size);
+
+/** @} */
+
+#ifndef HEADER_ONLY
+
+void *pool_get (Pool *pool) { void **item;
+  if (item = pool->free) { pool->free = *item; pool->count--; }
+  else item = calloc (1, pool->size);
+  pool->used++; return item;
+}
+
+void pool_put (Pool *pool, void *item) {
+  *(void **)item = pool->free; pool->free = item;
+  pool->count++; pool->used--;
+}
+
+void pool_resize (Pool *pool, int size) { void **item;
+  while (item = pool->free) { pool->free = *item; free (item); }
+  pool->count = 0; pool->size = size;
+}
+
+#endif
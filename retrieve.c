@@ -22,20 +22,24 @@
 #define RESOURCE_UPDATE (EVENT_NEW+7)
 #define RESOURCE_REMOVE (EVENT_NEW+8)
 #define RETRIEVE_FAIL (EVENT_NEW+9)
+#define RESOURCE_RETRY (EVENT_NEW+15)
 
 /** A Resource Stub. */
 typedef struct _Stub {
   Resource base; ///< is a container for the resource
-  void *conn; ///< is a pointer to an SeConnection
+  void *conn; ///< is a pointer to an SeConnection, the first of a pool
   int status; ///< is the HTTP status, 0 for a new Stub, -1 for an update
   time_t poll_next; ///< is the next time to poll the resource
   int16_t poll_rate; ///< is the poll rate for the resource
   unsigned complete : 1; ///< marks the Stub as complete
   unsigned subscribed : 1;
+  unsigned backoff : 1; ///< marks a retry pending after a 429 or 503 status
+  uint8_t retries; ///< is the number of consecutive 429 or 503 responses
   uint32_t flag; ///< is the marker for this resource in its dependents
   uint32_t flags; ///< is a bitwise requirements checklist
   uint32_t offset; ///< is the offset used for list paging
   uint32_t all; ///< is the total number of list items
+  uint16_t pages; ///< is the number of list page requests in flight
   struct _Stub *moved; ///< is a pointer to the new resource
   List *list; ///< is a list of old requirements for updates
   List *deps; ///< is a list of dependencies
@@ -133,17 +137,36 @@ typedef void (*DepFunc) (Stub *s);
  */
 int process_http (void *conn, DepFunc dep);
 
+/** @brief Retry the GET requests on an SeConnection that passed their
+    deadline.
+
+    Call when event_poll returns HTTP_TIMEOUT (see @ref http_deadline), the
+    requests are sent again on another connection to the server.
+    @param conn is a pointer to an SeConnection
+*/
+void retry_http (void *conn);
+
+/** @brief Request a resource again after a 429 or 503 response.
+
+    Call when event_poll returns RESOURCE_RETRY. A Stub is not removed when
+    the server is overloaded, the request is repeated after an exponential
+    backoff with jitter, at least the delay given by a Retry-After header.
+    @param s is a pointer to a Stub
+*/
+void retry_resource (Stub *s);
+
 /** @} */
 
+// requests are spread across the members of the connection pool
 void get_seq (Stub *s, int offset, int count) {
-  char *name = resource_name (s);
+  char *name = resource_name (s); void *conn = se_member (s->conn);
   if (count) { char uri[64];
     if (count > 255) count = 255;
     if (offset) sprintf (uri, "%s?s=%d&l=%d", name, offset, count);
     else sprintf (uri, "%s?l=%d", name, count);
-    http_get (s->conn, uri);
-  } else http_get (s->conn, name);
-  set_request_context (s->conn, s);
+    http_get (conn, uri); s->pages++;
+  } else http_get (conn, name);
+  set_request_context (conn, s);
 }
 
 void add_dep (Stub *r, Stub *d) {
@@ -176,7 +199,9 @@ void remove_deps (Stub *s, List *deps) { List *l;
   } free_list (deps);
 }
 
+// Stubs belong to the first member of a connection pool
 void *find_stub (Stub **head, char *name, void *conn) {
+  conn = se_primary (conn);
   if (*head = find_resource (name)) { Stub *s;
     foreach (s, *head) if (s->conn == conn) return s;
   } return NULL;
@@ -186,7 +211,7 @@ void *get_stub (char *name, int type, void *conn) {
   Stub *head, *s = find_stub (&head, name, conn);
   if (!s) {
     s = new_resource (sizeof (Stub), name, NULL, type);
-    s->conn = conn; s->poll_rate = 900; 
+    s->conn = se_primary (conn); s->poll_rate = 900;
     if (head) link_insert (list_next (head), s);
     else insert_resource (s);
   } return s;
@@ -220,9 +245,9 @@ void *insert_stub (List *list, Stub *s, ListInfo *info) {
   return list;
 }
 
-void delete_stub (Stub *s) {
-  http_delete (s->conn, resource_name (s));
-  set_request_context (s->conn, s);
+void delete_stub (Stub *s) { void *conn = se_member (s->conn);
+  http_delete (conn, resource_name (s));
+  set_request_context (conn, s);
 }
 
 void dep_complete (Stub *s) { List *l;
@@ -329,7 +354,7 @@ void update_existing (Stub *s, void *obj, DepFunc dep) {
   if (!s->flags) dep_complete (s);
 }
 
-// update paging and return number of items needed
+// update paging and return the number of items received
 int list_seq (Stub *s, void *obj) { int results;
   if (se_type_is_a (s->base.type, SE_SubscribableList)) {
     SE_SubscribableList_t *sl = obj;
@@ -339,7 +364,7 @@ int list_seq (Stub *s, void *obj) { int results;
   }
   // printf ("list_seq %d %d %d\n", s->offset, results, s->all);
   s->offset += results;
-  return s->all - s->offset;
+  return results;
 }
 
 char *object_path (Uri128 *buf, void *conn, void *data) {
@@ -349,9 +374,28 @@ char *object_path (Uri128 *buf, void *conn, void *data) {
   return NULL;
 }
 
-// process list object with dependency function
-int list_object (Stub *s, void *obj, DepFunc dep) {
-  Resource *r = &s->base; int count = list_seq (s, obj);
+// the start and limit of the list page request answered (see get_seq)
+void page_query (void *conn, int *start, int *limit) {
+  char *query = http_query (conn); *start = *limit = 0;
+  if (query && sscanf (query, "s=%d&l=%d", start, limit) < 2)
+    sscanf (query, "l=%d", limit);
+}
+
+/* Request the items of a list from offset to end in pages of the size
+   returned by the server, the requests are spread across the connection
+   pool. */
+void get_pages (Stub *s, int offset, int end, int size) { int n;
+  while (offset < end) {
+    get_seq (s, offset, n = min (size, end - offset)); offset += n;
+  }
+}
+
+/* Process list object with dependency function. A page answers the items
+   from its start up to its limit, the first page is also answerable for the
+   rest of the list. The items a page is short of are requested again, so a
+   short page from the middle of the list leaves no gap. */
+int list_object (Stub *s, void *conn, void *obj, DepFunc dep) {
+  Resource *r = &s->base; int start, limit, end, results = list_seq (s, obj);
   List **list = se_list_field (obj, r->info), *input, *l;
   input = *list; *list = NULL;
   if (!r->data) r->data = obj;
@@ -366,9 +410,16 @@ int list_object (Stub *s, void *obj, DepFunc dep) {
       free_se_object (l->data, r->info->type);
     }
   } free_list (input);
-  if (count > 0) get_seq (s, s->offset, count);
-  else if (!s->all) dep_complete (s);
-  return count;
+  if (s->pages) s->pages--;
+  page_query (conn, &start, &limit);
+  end = start && limit? min (start + limit, s->all) : s->all;
+  if (results && s->offset < s->all)
+    get_pages (s, start + results, end, results);
+  if (s->offset < s->all) {
+    // no pages left to receive, the server returns fewer items than it counts
+    if (!s->pages && !s->backoff) insert_event (s, RETRIEVE_FAIL, 0);
+  } else if (!s->all) dep_complete (s);
+  return s->all - s->offset;
 }
 
 Stub *find_target (void *conn) { Stub *head;
@@ -395,9 +446,10 @@ void process_response (void *conn, int status, DepFunc dep) {
       if (s = match_request (conn, obj, type)) {
 	s->base.time = time (NULL);
 	if (s->base.info)
-	  count = list_object (s, obj, dep);
+	  count = list_object (s, conn, obj, dep);
 	else update_existing (s, obj, dep);
 	if (!count) s->status = status;
+	s->retries = 0;
       } else free_se_object (obj, type);
     } break;
   case HTTP_POST:
@@ -427,15 +479,44 @@ void process_redirect (void *conn, int status) { Stub *s;
   } free_se_body (conn);
 }
 
+#define BACKOFF_BASE 1000 // ms, delay after the first 429 or 503 response
+#define BACKOFF_MAX 300000 // ms
+
+// schedule a retry, the delay doubles with each consecutive failure
+void backoff_resource (Stub *s, int retry_after) {
+  int64_t ms = min ((int64_t)BACKOFF_BASE << min (s->retries, 16),
+		    BACKOFF_MAX);
+  ms = ms / 2 + rand () % (ms / 2 + 1); // jitter, half to the full delay
+  if (retry_after >= 0) ms = max (ms, retry_after * (int64_t)1000);
+  if (s->retries < 255) s->retries++;
+  if (s->pages) s->pages--;
+  if (!s->backoff) { s->backoff = 1; insert_event_ms (s, RESOURCE_RETRY, ms); }
+}
+
+void retry_resource (Stub *s) {
+  s->backoff = 0;
+  if (s->status < 0) { // update in progress
+    if (s->all) s->offset = 0;
+    get_seq (s, 0, s->all);
+  }
+}
+
 int process_http (void *conn, DepFunc dep) {
   int status; Stub *s;
   switch (se_receive (conn)) {
   case HTTP_RESPONSE:
+    if (http_method (conn) == HTTP_GET && !http_context (conn)) {
+      free_se_body (conn); break; // late response to a retried request
+    }
     switch (status = http_status (conn)) {
     case 200: case 201: case 204:
       process_response (conn, status, dep); return status;
     case 300: case 301:
       process_redirect (conn, status); break;
+    case 429: case 503: // overloaded, keep the Stub and try again later
+      if (http_method (conn) == HTTP_GET && (s = find_target (conn)))
+	backoff_resource (s, http_retry_after (conn));
+      free_se_body (conn); break;
     default:
       if (http_method (conn) == HTTP_GET
 	  && (s = find_target (conn))) {
@@ -446,11 +527,20 @@ int process_http (void *conn, DepFunc dep) {
   } return 0;
 }
 
+// GET requests are replayed when the connection is re-established
 void cleanup_http (void *conn) {
-  HttpRequest *r = http_queued (conn), *next;
-  while (r) { next = r->next;
-    if (r->method == HTTP_GET)
-      remove_stub (r->context);
-    free (r); r = next;
+  free_list (http_replay (conn));
+}
+
+/* GET requests that pass their deadline are retried on another member of
+   the connection pool, a late response to the original request has no
+   context and is ignored */
+void retry_http (void *conn) {
+  HttpRequest *r = http_expired (conn), *next; void *alt;
+  for (; r; r = next) { next = r->next;
+    if (r->method == HTTP_GET && r->context) {
+      http_get (alt = se_alternate (conn), r->uri);
+      set_request_context (alt, r->context);
+    } free (r);
   }
 }
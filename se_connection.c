@@ -10,6 +10,8 @@
 */
 
 #define SE_CONNECTION EVENT_NEW
+#define SE_IDLE (EVENT_NEW+16) ///< A client connection was idle (@ref se_idle)
+#define SE_RECONNECT (EVENT_NEW+17) ///< Backoff over (@ref se_redial)
 
 #define SE_ERROR (HTTP_RESPONSE+1)
 #define SE_INCOMPLETE (HTTP_RESPONSE+2)
@@ -49,6 +51,17 @@ enum SeMediaType {SE_EXI, SE_XML, APPLICATION_XML};
 */
 void *se_send (void *conn, void *obj, int type, char *href, int method);
 
+/** @brief Respond to a request with an IEEE 2030.5 object.
+
+    The object is output using the media type negotiated from the Accept
+    header of the request (see @ref se_content_type).
+    @param conn is a pointer to an SeConnection
+    @param status is the HTTP status, typically 200
+    @param obj is a pointer to an IEEE 2030.5 object
+    @param type is the schema type of the object
+*/
+void se_respond (void *conn, int status, void *obj, int type);
+
 /** @brief Initialize a Response to an Event.
 
     @param resp is a pointer to an SE_Response_t object or dervied type.
@@ -104,9 +117,13 @@ int se_receive (void *conn);
 
 /** @brief Connect to an IEEE 2030.5 server.
 
-    Only one connection is maintained per server address/port, so this function
-    first searches a list of existing connection for a matching Address, before
-    creating a new connection.
+    A pool of connections is maintained per server address/port, so this
+    function first searches a list of existing connections for a pool with a
+    matching Address, before creating a new connection. The connection
+    returned is the first member of the pool and identifies the pool, use
+    @ref se_member to select a member for a request. The list of connections
+    is kept per thread, so each thread running a @ref reactor maintains its
+    own connections.
     @param addr is a pointer to Address of the server
     @param secure is 1 for a encrypted TLS connection, 0 for an unencrypted
     TCP connection
@@ -114,6 +131,22 @@ int se_receive (void *conn);
 */
 void *se_connect (Address *addr, int secure);
 
+/** @brief Connect to an IEEE 2030.5 server with two addresses.
+
+    The same as @ref se_connect, but the members of the connection pool race
+    the two addresses (Happy Eyeballs, see @ref net_connect_any), e.g. the
+    IPv6 and IPv4 addresses of a server found with DNS-SD, so a black-holed
+    address family does not delay the connection by a TCP timeout.
+    @param addr is a pointer to the preferred Address of the server, it
+    identifies the pool
+    @param alt is a pointer to another Address of the server, NULL to keep
+    the address given previously (if any)
+    @param secure is 1 for a encrypted TLS connection, 0 for an unencrypted
+    TCP connection
+    @returns a pointer to an SeConnection
+*/
+void *se_connect_alt (Address *addr, Address *alt, int secure);
+
 /** @brief Connect to an IEEE 2030.5 server using a Uri parameter.
 
     The same as @ref se_connect, but uses a Uri as a parameter. The URI scheme
@@ -132,6 +165,133 @@ void *se_connect_uri (Uri *uri);
 */
 void *se_accept (Acceptor *a, int secure);
 
+/** @brief Queue a number of connections to accept IEEE 2030.5 clients.
+
+    The connections are allocated once and queued on the Acceptor, so that a
+    burst of connection requests is accepted without waiting for the
+    application to queue another connection. Use @ref se_recycle to return a
+    closed connection to the Acceptor.
+    @param a is a pointer to an Acceptor
+    @param secure is 1 for encrypted TLS connections, 0 for unencrypted TCP
+    connections
+    @param n is the number of connections
+*/
+void se_accept_pool (Acceptor *a, int secure, int n);
+
+/** @brief Reuse a closed server connection to accept another client.
+
+    Call when event_poll returns TCP_CLOSED for a connection from
+    @ref se_accept or @ref se_accept_pool, client connections are ignored.
+    @param conn is a pointer to an SeConnection
+*/
+void se_recycle (void *conn);
+
+/** @brief Set the maximum number of connections per server.
+
+    Members of a connection pool are connected as needed, when every member
+    has outstanding requests. The default pool size is 2.
+    @param size is the maximum number of connections per server
+*/
+void se_pool (int size);
+
+/** @brief Limit the rate of requests to each server.
+
+    The members of a connection pool share a token bucket (see
+    @ref http_limit), the limit applies to pools created after the call.
+    @param rate is the number of requests per second, 0 (the default) for no
+    limit
+    @param burst is the maximum number of requests sent at once
+*/
+void se_rate_limit (double rate, int burst);
+
+/** @brief Select a member of a connection pool for a request.
+
+    Returns an idle member if there is one, otherwise a new member is
+    connected if the pool is not full, otherwise the member with the least
+    outstanding requests is returned. A closed member is reconnected, unless
+    it is backing off (see @ref se_closed).
+    @param conn is a pointer to an SeConnection, any member of a pool
+    @returns a pointer to an SeConnection, conn if it is not a client
+    connection from @ref se_connect
+*/
+void *se_member (void *conn);
+
+/** @brief Select a member of a connection pool other than conn.
+
+    The same as @ref se_member but conn is not selected, used to retry a
+    request on another connection to the server.
+    @param conn is a pointer to an SeConnection
+    @returns a pointer to an SeConnection, conn if the pool size is 1
+*/
+void *se_alternate (void *conn);
+
+/** @brief Get the first member of a connection pool.
+    @param conn is a pointer to an SeConnection
+    @returns the connection that identifies the pool of conn
+*/
+void *se_primary (void *conn);
+
+/** @brief Close client connections that are idle.
+
+    A client connection without outstanding requests for the time given is
+    closed (event_poll returns SE_IDLE, handled by @ref se_idle), and
+    reconnected when a request is made, so quiet servers do not hold a
+    socket. Applies to connections opened after the call.
+    @param seconds is the idle timeout, 0 (the default) to keep connections
+    open
+*/
+void se_idle_timeout (int seconds);
+
+/** @brief Close a client connection if it is still idle.
+
+    Call when event_poll returns SE_IDLE.
+    @param conn is a pointer to an SeConnection
+*/
+void se_idle (void *conn);
+
+/** @brief Back off before reconnecting a client connection.
+
+    Call when event_poll returns TCP_CLOSED or TCP_TIMEOUT for a client
+    connection. Devices that lose a server at the same time should not
+    reconnect at the same instant, so the connection is held closed for a
+    random delay between half and the whole of a backoff that doubles with
+    each loss (from 1 second up to 5 minutes) and is reset by a response.
+    Then event_poll returns SE_RECONNECT (handled by @ref se_redial).
+    GET requests in flight or waiting are kept and sent again on the new
+    connection (see @ref http_replay), other requests are freed. Requests
+    made in the meantime wait for the reconnect.
+    @param conn is a pointer to an SeConnection
+    @returns 1 if the connection was closed by @ref se_idle (no backoff, it
+    is reconnected on demand), 0 otherwise
+*/
+int se_closed (void *conn);
+
+/** @brief Reconnect a client connection after the backoff.
+
+    Call when event_poll returns SE_RECONNECT, the connection is reconnected
+    if requests are waiting, otherwise when the next request is made.
+    @param conn is a pointer to an SeConnection
+*/
+void se_redial (void *conn);
+
+/** @brief Connection statistics, kept per thread. */
+typedef struct {
+  uint64_t connects; ///< client connections opened
+  uint64_t reconnects; ///< connections opened again after a loss
+  uint64_t reopened; ///< idle connections opened again on demand
+  uint64_t closed; ///< connections lost (closed by the server or timed out)
+  uint64_t reaped; ///< idle connections closed
+  int storm; ///< the most reconnects within one second
+} SeStats;
+
+/** @brief Get the connection statistics of the thread.
+    @returns a pointer to the SeStats
+*/
+SeStats *se_stats ();
+
+/** @brief Print the connection statistics of the thread. */
+void print_se_stats ();
+
 void *find_conn (Address *addr);
 void *get_conn (Address *addr);
 
@@ -142,10 +302,21 @@ void *get_conn (Address *addr);
 typedef struct _SeConnection {
   HttpConnection http;
   Address host;
-  Parser parser;
+  Address alt; // another address of the host, raced with host if set
+  Parser *parser; // borrowed while a message body is parsed
+  void *obj; int type; // completed object and type
   int state, media;
   uint64_t sfdi;
+  unsigned secure : 1; // connection uses TLS
+  unsigned opened : 1; // connected before, the next connect is a reconnect
+  unsigned reaped : 1; // closed by se_idle
+  unsigned retrying : 1; // backing off, the reconnect is scheduled
+  int backoff; // reconnect backoff in ms, 0 until a connection is lost
+  Timer idle, retry; // SE_IDLE and SE_RECONNECT
+  Acceptor *acceptor; // server connection, accepts clients from
   struct _SeConnection *next;
+  struct _SeConnection *primary; // first member of the connection pool
+  struct _SeConnection *member; // next member of the connection pool
 } SeConnection;
 
 const char * const se_ranges[] = {
@@ -177,13 +348,20 @@ int select_media (char *range) {
   } return type;
 }
 
+// parsers are borrowed from the pool, the XmlParser is kept with the Parser
+__thread Pool se_parsers = {NULL, sizeof (Parser)};
+
+void se_parser_release (SeConnection *c) {
+  if (c->parser) { pool_put (&se_parsers, c->parser); c->parser = NULL; }
+}
+
 int se_parse_init (void *conn) {
   SeConnection *c = conn;
   HttpConnection *h = &c->http;
-  MediaType media; int type = 3;
-  Parser *p = &c->parser;
+  MediaType media; int type = 3; Parser *p;
   if (h->content_type && media_range (&media, h->content_type))
     type = se_range (media.type);
+  if (!(p = c->parser)) p = c->parser = pool_get (&se_parsers);
   switch (type) {
   case SE_EXI: exi_parse_init (p, &se_schema, NULL, 0); break;
   case SE_XML: case APPLICATION_XML:
@@ -198,37 +376,40 @@ uint64_t *se_sfdi (void *conn) {
 
 void free_se_body (void *conn) {
   SeConnection *s = conn;
-  if (s->parser.obj) {
-    free_se_object (s->parser.obj, s->parser.type);
-    s->parser.obj = NULL;
-  }
+  if (s->obj) { free_se_object (s->obj, s->type); s->obj = NULL; }
 }
 
 void *se_body (void *conn, int *type) {
   SeConnection *s = conn; void *body;
-  if (body = s->parser.obj) { 
-    *type = s->parser.type;
-    s->parser.obj = NULL;
-  } return body; 
+  if (body = s->obj) { *type = s->type; s->obj = NULL; }
+  return body; 
 }
 
 #define SE_START 0
 #define SE_DATA 1
 
 // return HTTP method, SE_ERROR, or SE_INCOMPLETE 
+int se_idle_ms = 0;
+
+// restart the idle timeout of a client connection
+void se_active (SeConnection *c) {
+  if (se_idle_ms && http_client (c)) set_timer_ms (&c->idle, se_idle_ms);
+}
+
 int se_receive (void *conn) {
   SeConnection *s = conn;
   HttpConnection *h = conn;
-  Parser *p = &s->parser;
+  Parser *p;
   char *data;
-  int length, type, code, method;
-  http_flush (h);
+  int length, code, method;
+  http_flush (h); se_active (s);
   switch (method = http_receive (h)) {
   case HTTP_NONE: break;
   case HTTP_ERROR: return SE_ERROR;
   default:
     switch (s->state) {
-    case SE_START: p->obj = NULL;
+    case SE_START: s->obj = NULL;
+      if (method == HTTP_RESPONSE) s->backoff = 0;
       print_http_status (h);
       if (h->media_range)
 	s->media = select_media (h->media_range);
@@ -236,11 +417,11 @@ int se_receive (void *conn) {
 	if (se_parse_init (s)) s->state++;
 	else { code = 415; goto error; }
       } else return method;
-    case SE_DATA:
+    case SE_DATA: p = s->parser;
       while (data = http_data (h, &length)) {
 	parser_rebuffer (p, data, length);
-	if (parse_doc (p, &type)) {
-	  s->state = SE_START; return method;
+	if (s->obj = parse_doc (p, &s->type)) {
+	  se_parser_release (s); s->state = SE_START; return method;
 	} else if (!http_complete (h)) {
 	  http_rebuffer (h, p->ptr);
 	} else {
@@ -253,12 +434,14 @@ int se_receive (void *conn) {
   }
   return SE_INCOMPLETE;
  error:
+  se_parser_release (s); s->state = SE_START;
   if (h->method == HTTP_RESPONSE) http_close (h);
   else http_error (h, code);
   return SE_ERROR;
 }
 
-SeConnection *connections = NULL;
+// connections are owned by the thread (Reactor) that created them
+__thread SeConnection *connections = NULL;
 int se_media = SE_XML;
 
 void *new_conn (int client) {
@@ -268,37 +451,187 @@ void *new_conn (int client) {
   char *media = se_media == SE_XML? "application/sep+xml"
     : "application/sep-exi";
   http_init (c, client, accept, media);
+  timer_init (&c->idle, SE_IDLE, c); timer_init (&c->retry, SE_RECONNECT, c);
   c->media = se_media;
   c->next = connections; connections = c;
   return c;
 }
 
 void *find_conn (Address *addr) { SeConnection *c;
-  foreach (c, connections)
-    if (http_client (c) && address_eq (&c->host, addr)) return c;
+  for (c = connections; c; c = c->next) // next is not the first field
+    if (http_client (c) && c->primary == c && address_eq (&c->host, addr))
+      return c;
   return NULL;
 }
 
+double se_rate = 0; int se_burst;
+
 void *get_conn (Address *addr) {
   SeConnection *c = find_conn (addr);
-  return c? c : new_conn (1);
+  if (!c) { c = new_conn (1); c->primary = c;
+    if (se_rate) http_limit (c, http_limit_new (se_rate, se_burst));
+  } return c;
 }
 
-void *se_connect (Address *addr, int secure) {
+#define RECONNECT_BASE 1000 // first reconnect backoff in ms
+#define RECONNECT_MAX 300000 // maximum reconnect backoff in ms
+
+__thread SeStats _se_stats;
+__thread uint64_t _storm_start; __thread int _storm;
+
+void se_idle_timeout (int seconds) { se_idle_ms = seconds * 1000; }
+
+SeStats *se_stats () { return &_se_stats; }
+
+void print_se_stats () { SeStats *s = &_se_stats;
+  printf ("connections: %ld opened, %ld reconnected (at most %d in one "
+	  "second), %ld reopened, %ld lost, %ld idle closed\n",
+	  (long)s->connects, (long)s->reconnects, s->storm, (long)s->reopened,
+	  (long)s->closed, (long)s->reaped);
+}
+
+void count_connect (SeConnection *c) { uint64_t now;
+  if (c->reaped) _se_stats.reopened++;
+  else if (c->opened) { now = clock_ms ();
+    if (now - _storm_start >= 1000) { _storm_start = now; _storm = 0; }
+    _se_stats.reconnects++; _storm++;
+    _se_stats.storm = max (_se_stats.storm, _storm);
+  } else _se_stats.connects++;
+  c->opened = 1; c->reaped = 0;
+}
+
+// connect a member of a pool, racing the alternate address if there is one
+void se_dial (SeConnection *c) { Address addrs[2];
+  count_connect (c); se_active (c);
+  if (!c->alt.length) { conn_connect (c, &c->host, c->secure); return; }
+  address_copy (&addrs[0], &c->host); address_copy (&addrs[1], &c->alt);
+  conn_connect_any (c, addrs, 2, c->secure);
+}
+
+// connect a closed member unless it is backing off
+void se_open (SeConnection *c) {
+  if (net_status (c) == Closed && !c->retrying) se_dial (c);
+}
+
+void se_idle (void *conn) { SeConnection *c = conn;
+  if (net_status (c) != Connected) return;
+  if (http_outstanding (c)) { se_active (c); return; }
+  c->reaped = 1; _se_stats.reaped++;
+  free_list (http_replay (c)); // closed, ready to connect again
+}
+
+int se_closed (void *conn) { SeConnection *c = conn; int delay;
+  if (!http_client (c) || c->retrying) return 0;
+  // a response body cut off by the close is parsed again when replayed
+  se_parser_release (c); c->state = SE_START;
+  set_timer_ms (&c->idle, 0);
+  if (c->reaped) return 1; // replayed by se_idle
+  free_list (http_replay (c));
+  _se_stats.closed++;
+  c->backoff = c->backoff? min (c->backoff * 2, RECONNECT_MAX)
+    : RECONNECT_BASE;
+  delay = c->backoff / 2 + rand () % (c->backoff / 2 + 1);
+  c->retrying = 1; set_timer_ms (&c->retry, delay); return 0;
+}
+
+void se_redial (void *conn) { SeConnection *c = conn;
+  c->retrying = 0;
+  if (http_outstanding (c)) se_open (c);
+}
+
+void *se_connect_alt (Address *addr, Address *alt, int secure) {
   SeConnection *c = get_conn (addr);
-  address_copy (&c->host, addr); 
-  if (net_status (c) == Closed)
-    conn_connect (c, addr, secure);
+  address_copy (&c->host, addr); c->secure = secure;
+  if (alt) address_copy (&c->alt, alt);
+  se_open (c);
   if (conn_session (c)) http_flush (c); return c;
 }
 
+void *se_connect (Address *addr, int secure) {
+  return se_connect_alt (addr, NULL, secure);
+}
+
+int se_pool_size = 2;
+
+void se_pool (int size) { se_pool_size = max (size, 1); }
+
+void se_rate_limit (double rate, int burst) {
+  se_rate = rate; se_burst = burst;
+}
+
+void *se_primary (void *conn) { SeConnection *c = conn;
+  return c->primary? c->primary : c;
+}
+
+// select the member with the least outstanding requests, other than skip
+SeConnection *pool_member (SeConnection *c, SeConnection *skip) {
+  SeConnection *m, *best = NULL; int n, least = INT_MAX, size = 0;
+  for (m = c; m; m = m->member, size++)
+    if (m != skip && !m->retrying && (n = http_outstanding (m)) < least) {
+      best = m; least = n;
+    }
+  // no new members while the server is lost, the requests wait
+  if (least && size < se_pool_size && !c->retrying) { // connect a new member
+    best = new_conn (1); best->primary = c; best->secure = c->secure;
+    address_copy (&best->host, &c->host); address_copy (&best->alt, &c->alt);
+    best->http.window = c->http.window; best->http.deadline = c->http.deadline;
+    best->http.limit = c->http.limit;
+    best->member = c->member; c->member = best;
+  } else if (!best) best = skip? skip : c;
+  se_open (best); return best;
+}
+
+void *se_member (void *conn) { SeConnection *c = conn;
+  return c->primary? pool_member (c->primary, NULL) : conn;
+}
+
+void *se_alternate (void *conn) { SeConnection *c = conn;
+  return c->primary? pool_member (c->primary, c) : conn;
+}
+
 void *se_connect_uri (Uri *uri) {
   int secure = streq (uri->scheme, "https");
   return se_connect (uri->host, secure);
 }
 
-void *se_accept (Acceptor *a, int secure) {
-  return conn_accept (new_conn (0), a, secure);
+void *se_accept (Acceptor *a, int secure) { SeConnection *c = new_conn (0);
+  c->acceptor = a; c->secure = secure;
+  return conn_accept (c, a, secure);
+}
+
+void se_accept_pool (Acceptor *a, int secure, int n) {
+  while (n-- > 0) se_accept (a, secure);
+}
+
+void se_recycle (void *conn) { SeConnection *c = conn; HttpConnection *h = conn;
+  if (h->client || !c->acceptor || net_status (c) != Closed) return;
+  send_queue_free (&h->send); http_release (h);
+  h->state = HTTP_START; h->close = 0;
+  free_se_body (c); se_parser_release (c); c->state = SE_START;
+  conn_accept (c, c->acceptor, c->secure);
+}
+
+// write a message with an object body, header holds the first n bytes
+void se_write (SeConnection *c, char *header, int n, void *data, int type) {
+  Output o; char *body = malloc (4096); struct iovec iov[2]; int length;
+  const char *media = se_ranges[c->media];
+  se_output_init (&o, body, 4096, c->media);
+  length = output_doc (&o, data, type);
+  if (output_complete (&o)) {
+    n += http_content (header+n, media, length);
+    iov[0].iov_base = header; iov[0].iov_len = n;
+    iov[1].iov_base = body; iov[1].iov_len = length;
+    http_writev (c, iov, 2, 2); // the body is passed by reference
+  } else { // stream a larger document in chunks as it is output
+    n += http_chunked (header+n, media);
+    http_write (c, header, n);
+    do if (length) http_chunk (c, body, length); // 0 is the last chunk
+    while (!output_complete (&o) && (length = output_doc (&o, data, type)));
+    free (body);
+    // an output error leaves a truncated document, it must not end normally
+    if (output_complete (&o)) http_chunk (c, NULL, 0);
+    else http_close (c);
+  }
 }
 
 void *se_send (void *conn, void *data, int type,
@@ -306,18 +639,21 @@ void *se_send (void *conn, void *data, int type,
   Uri128 buf; Uri *uri = &buf.uri;
   http_parse_uri (&buf, conn, href, 127);
   if (uri->host) conn = se_connect_uri (uri);
-  if (conn) { Output o; char buffer[4096];
-    SeConnection *c = conn; int length, header;
-    header = http_send (conn, buffer, uri->path, method);
-    se_output_init (&o, buffer+header, 4096-header, c->media);
-    length = output_doc (&o, data, type);
-    set_content_length (buffer, length); length += header;
+  if (conn) conn = se_member (conn); // an idle member of the pool
+  if (conn) { char header[512];
     printf ("se_send:\n");
-    http_write (conn, buffer, length);
+    se_write (conn, header, http_request (conn, header, uri->path, method),
+	      data, type);
     print_se_object (data, type); printf ("\n");
   } return conn;
 }
 
+void se_respond (void *conn, int status, void *obj, int type) {
+  char header[512]; int n = http_status_line (header, status,
+					      http_reason (status));
+  se_write (conn, header, n, obj, type);
+}
+
 void se_response (void *resp, SE_Event_t *ev, char *lfdi, int status) {
   SE_Response_t *r = resp;
   r->_flags = SE_createdDateTime_exists | SE_status_exists;
@@ -5,6 +5,7 @@
 #include "util.c"
 #include "list.c"
 #include "queue.c"
+#include "pool.c"
 #include "platform.c"
 #include "parse.c"
 #include "xml_parse.c"
@@ -15,8 +16,8 @@
 #include "se_types.h"
 #include "se_object.c"
 #include "sha256.c"
-#include "openssl.c"
 #include "security.c"
+#include "openssl.c"
 #include "connection.c"
 #include "uri.c"
 #include "http.c"
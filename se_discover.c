@@ -58,6 +58,9 @@ char *service_dcap (Service *s);
 int service_type (Service *s);
 
 /** @brief Connect to a given service, return the connection.
+
+    If the host has both an IPv6 and an IPv4 address, the connection races
+    the two (see @ref se_connect_alt).
     @param s is a pointer to a Service
     @param secure indicates whether to attempt a secure TLS connection or not,
     this is only possible when the 'https' key is set.
@@ -157,14 +160,15 @@ int service_type (Service *s) {
 }
 
 void *service_connect (Service *service, int secure) {
-  Address *addr; char buffer[32]; char *https = NULL;
+  Address *addr, *alt; char buffer[32]; char *https = NULL;
   if (secure) https = txt_value (buffer, service->txt, "https");
   int port = https? (*https == '\0'? 443 : atol (https)) : service->port,
     n_port = htons (port);
   printf ("service_connect: connect on port %d, https = %s, port = %d\n",
 	  port, https, service->port); 
   addr = &service->host->addr; addr->port = n_port;
-  return se_connect (addr, https != NULL);
+  alt = &service->host->alt; alt->port = n_port;
+  return se_connect_alt (addr, alt->length? alt : NULL, https != NULL);
 }
 
 Service *service_receive (UdpPort *port) {
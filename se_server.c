@@ -0,0 +1,122 @@
+// Copyright (c) 2018 Electric Power Research Institute, Inc.
+// author: Mark Slicker <mark.slicker@gmail.com>
+
+/** @defgroup se_server Server
+    @ingroup se_connection
+
+    Dispatches the requests received on server connections to handlers
+    registered for path prefixes. Paths without a handler are served from the
+    Resource database, a GET request returns the resource object in the media
+    type negotiated with the client.
+    @{
+*/
+
+/** @brief A request handler.
+
+    The handler either responds to the request itself and returns 0, or
+    returns an HTTP status for a response without a body.
+    @param conn is a pointer to the SeConnection that received the request
+    @param method is the HTTP method of the request
+    @param path is the request path (see @ref http_query for the query)
+    @param obj is the request body as an IEEE 2030.5 object or NULL if there
+    is no body, the handler is responsible for freeing it
+    @param type is the schema type of obj
+    @returns 0 if the handler responded, otherwise an HTTP status
+*/
+typedef int (*SeHandler) (void *conn, int method, char *path,
+			  void *obj, int type);
+
+/** @brief Route the requests for a path prefix to a handler.
+
+    Prefixes match whole path segments, "/edev" matches "/edev" and
+    "/edev/3/der" but not "/edevx". The handler with the longest matching
+    prefix is called.
+    @param prefix is the path prefix, "/" matches every path
+    @param handler is a pointer to an SeHandler, NULL to serve the paths from
+    the Resource database (see @ref serve_resource)
+*/
+void se_route (const char *prefix, SeHandler handler);
+
+/** @brief Serve the requests received on a server connection.
+
+    Call when event_poll returns TCP_PORT for a connection from
+    @ref se_accept, each complete request is dispatched to its handler.
+    @param conn is a pointer to an SeConnection
+    @returns the number of requests handled
+*/
+int se_serve (void *conn);
+
+/** @brief Serve a request from the Resource database.
+
+    The default handler, a GET request is answered with the object of the
+    Resource named by the path (404 if there is none), other methods are not
+    allowed (405).
+*/
+int serve_resource (void *conn, int method, char *path, void *obj, int type);
+
+/** @} */
+
+/* Routes form a trie of path segments, the children of a route are the
+   routes for longer prefixes */
+typedef struct _Route {
+  struct _Route *next; // next sibling
+  struct _Route *child; // first child
+  SeHandler handler; // NULL if only a part of a longer prefix
+  int length; char segment[];
+} Route;
+
+Route se_routes; // the route for "/"
+
+// find or add the child of a route for a path segment
+Route *route_child (Route *r, const char *segment, int length, int add) {
+  Route *c;
+  for (c = r->child; c; c = c->next)
+    if (c->length == length && !memcmp (c->segment, segment, length))
+      return c;
+  if (!add) return NULL;
+  c = calloc (1, sizeof (Route) + length + 1);
+  memcpy (c->segment, segment, length); c->length = length;
+  c->next = r->child; return r->child = c;
+}
+
+// skip to the next path segment, returns its length
+int path_segment (const char **path) { const char *p = *path; int n = 0;
+  while (*p == '/') p++;
+  while (p[n] && p[n] != '/') n++;
+  *path = p; return n;
+}
+
+void se_route (const char *prefix, SeHandler handler) {
+  Route *r = &se_routes; int n;
+  while (n = path_segment (&prefix)) {
+    r = route_child (r, prefix, n, 1); prefix += n;
+  } r->handler = handler? handler : serve_resource;
+}
+
+// the handler for the longest prefix of the path with a route
+SeHandler find_route (const char *path) {
+  Route *r = &se_routes; SeHandler h = r->handler; int n;
+  while ((n = path_segment (&path)) && (r = route_child (r, path, n, 0))) {
+    if (r->handler) h = r->handler;
+    path += n;
+  } return h? h : serve_resource;
+}
+
+int serve_resource (void *conn, int method, char *path, void *obj, int type) {
+  Resource *r;
+  if (obj) free_se_object (obj, type);
+  if (method != HTTP_GET) { http_allow (conn, "GET"); return 0; }
+  if (!(r = find_resource (path)) || !r->data) return 404;
+  se_respond (conn, 200, r->data, r->type); return 0;
+}
+
+int se_serve (void *conn) {
+  int method, type, status, n = 0; void *obj; char *path;
+  while ((method = se_receive (conn)) != SE_INCOMPLETE) {
+    if (method == SE_ERROR) continue; // the error response is sent
+    obj = se_body (conn, &type); path = http_path (conn);
+    if (status = find_route (path) (conn, method, path, obj, type))
+      http_respond (conn, status);
+    n++;
+  } return n;
+}
@@ -0,0 +1,66 @@
+#include "../se_core.c"
+
+// two Acceptors listen on the same port (SO_REUSEPORT, as reactors in
+// separate threads would), each with a pool of server connections smaller
+// than the number of clients; rounds of clients connect at once, make a
+// request and close, the server connections are recycled and every client
+// is answered without allocating more connections
+
+#define CLIENTS 200
+#define POOL 32 // server connections per Acceptor
+#define ROUNDS 3
+
+HttpConnection clients[ROUNDS][CLIENTS];
+int accepts, answered;
+
+void server_event (void *conn) {
+  while (http_receive (conn) == HTTP_GET) http_respond (conn, 204);
+}
+
+void client_event (HttpConnection *c) {
+  while (http_receive (c) == HTTP_RESPONSE)
+    if (http_status (c) == 204) { answered++; conn_close (c); }
+}
+
+// handle events until every client is answered and the connections closed
+int poll_events () { void *any;
+  while (1)
+    switch (event_poll (&any, answered < CLIENTS? 5000 : 100)) {
+    case TCP_ACCEPT: accepts++; // data may be waiting
+    case TCP_PORT:
+      if (http_client (any)) client_event (any);
+      else server_event (any);
+      break;
+    case TCP_CONNECT: case TCP_WRITABLE: http_flush (any); break;
+    case TCP_CLOSED: se_recycle (any); break;
+    case POLL_TIMEOUT: return answered == CLIENTS;
+    case TCP_TIMEOUT: return 0;
+    }
+}
+
+int main () {
+  char zero[16] = {0}; Address addr; Acceptor *a, *b; SeConnection *c;
+  int i, round, servers = 0;
+  printf ("Accept test, %d clients, %d server connections\n",
+	  CLIENTS, POOL * 2);
+  platform_init (); net_backlog (CLIENTS);
+  ipv6_address (&addr, zero, 12355);
+  a = net_listen (&addr); b = net_listen (&addr);
+  se_accept_pool (a, 0, POOL); se_accept_pool (b, 0, POOL);
+  for (round = 0; round < ROUNDS; round++) {
+    answered = 0;
+    for (i = 0; i < CLIENTS; i++) { HttpConnection *c = &clients[round][i];
+      http_init (c, 1, "text/plain", "text/plain");
+      conn_connect (c, &addr, 0); http_get (c, "/");
+    }
+    if (!poll_events ()) {
+      printf ("  %d of %d clients answered\n", answered, CLIENTS);
+      return 1;
+    }
+    printf ("  round %d: %d clients answered\n", round + 1, answered);
+  }
+  for (c = connections; c; c = c->next) servers += !http_client (c);
+  printf ("  %d connections accepted, %d server connections\n",
+	  accepts, servers);
+  return accepts < CLIENTS * ROUNDS || servers != POOL * 2;
+}
@@ -0,0 +1,118 @@
+#include "../se_core.c"
+
+// sends a request body with chunked transfer coding (chunks of random size
+// with extensions and a trailer) followed by a pipelined GET request, the
+// server responds with a chunked body written with http_chunk; the bodies
+// are larger than the receive buffer and are checked as they stream
+
+#define BODY (256 << 10) // request body size
+#define RESPONSE (100 << 10) // response body size
+#define CHUNK 1000 // response chunk size
+
+HttpConnection *client, *server;
+int received, receiving, responses;
+
+#define pattern(i) ('a' + (i) % 26)
+
+void check (const char *name, char *data, int length) { int i;
+  for (i = 0; i < length; i++)
+    if (data[i] != pattern (received + i)) {
+      printf ("  %s body corrupted at %d\n", name, received + i); exit (1);
+    }
+  received += length;
+}
+
+void post () { char *body = malloc (BODY * 2), header[512], chunk[CHUNK];
+  int i = 0, n, k, length = 0;
+  n = http_request (client, header, "/upload", HTTP_POST);
+  n += sprintf (header+n, "Transfer-Encoding: chunked\r\n\r\n");
+  http_write (client, header, n);
+  while (i < BODY) {
+    n = min (1 + rand () % 3000, BODY - i);
+    length += sprintf (body+length, i % 3? "%x\r\n" : "%X;ext=%d\r\n", n, i);
+    for (k = 0; k < n; k++) body[length++] = pattern (i + k);
+    length += sprintf (body+length, "\r\n"); i += n;
+  }
+  length += sprintf (body+length, "0\r\nX-Check: 1\r\n\r\n");
+  http_write (client, body, length); free (body);
+  http_get (client, "/next");
+}
+
+void respond () { char header[512], chunk[CHUNK]; int i, k;
+  int n = http_status_line (header, 200, "OK");
+  n += http_chunked (header+n, "text/plain");
+  http_write (server, header, n);
+  for (i = 0; i < RESPONSE; i += CHUNK) {
+    for (k = 0; k < CHUNK; k++) chunk[k] = pattern (i + k);
+    http_chunk (server, chunk, min (CHUNK, RESPONSE - i));
+  } http_chunk (server, NULL, 0);
+}
+
+// read the body of a message, returns 1 when complete
+int body (HttpConnection *c, const char *name, int size) {
+  char *data; int length;
+  while ((data = http_data (c, &length)) && length) {
+    check (name, data, length); http_rebuffer (c, data + length);
+  }
+  if (!http_complete (c)) return 0;
+  if (received != size) {
+    printf ("  %s body %d bytes, expected %d\n", name, received, size);
+    exit (1);
+  } received = receiving = 0; return 1;
+}
+
+void server_event () { int method;
+  while (1) {
+    if (!receiving) {
+      switch (method = http_receive (server)) {
+      case HTTP_POST: receiving = 1; break;
+      case HTTP_GET: http_respond (server, 204); continue;
+      default: return;
+      }
+    }
+    if (!body (server, "request", BODY)) return;
+    respond ();
+  }
+}
+
+int client_event () {
+  while (1) {
+    if (!receiving) {
+      if (http_receive (client) != HTTP_RESPONSE) return 0;
+      if (http_method (client) == HTTP_GET)
+	return http_status (client) == 204;
+      receiving = 1;
+    }
+    if (!body (client, "response", RESPONSE)) return 0;
+  }
+}
+
+int main () {
+  char zero[16] = {0}; Address addr; Acceptor *a;
+  int connected = 0, done = 0; void *any;
+  printf ("Chunked transfer coding test, %d byte request, %d byte response\n",
+	  BODY, RESPONSE);
+  platform_init (); http_buffer_size (512, 65536);
+  ipv6_address (&addr, zero, 12350);
+  client = type_alloc (HttpConnection); server = type_alloc (HttpConnection);
+  http_init (client, 1, "text/plain", "text/plain");
+  http_init (server, 0, "text/plain", "text/plain");
+  a = net_listen (&addr);
+  conn_accept (server, a, 0); conn_connect (client, &addr, 0);
+  while (!done) {
+    switch (event_poll (&any, -1)) {
+    case TCP_ACCEPT: case TCP_CONNECT:
+      if (++connected == 2) post ();
+      break;
+    case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (any == server) server_event ();
+      else done = client_event ();
+      break;
+    case TCP_CLOSED: case TCP_TIMEOUT:
+      printf ("  connection lost\n"); return 1;
+    }
+  }
+  printf ("  request and response bodies received\n");
+  return 0;
+}
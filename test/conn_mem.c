@@ -0,0 +1,107 @@
+#include <malloc.h>
+#include "../se_core.c"
+
+// reports the heap memory used per SeConnection while idle and while a
+// message is in flight, the receive buffer, request target, and parser are
+// borrowed from per thread pools only while a message is in flight
+
+#define PAIRS 200 // client/server connection pairs
+#define BATCH 50 // connections made at a time, within the listen backlog
+
+SeConnection *clients[PAIRS], *servers[PAIRS];
+int done;
+
+const char *body = "<Time xmlns=\"urn:ieee:std:2030.5:ns\">"
+  "<currentTime>0</currentTime><dstEndTime>0</dstEndTime>"
+  "<dstOffset>0</dstOffset><dstStartTime>0</dstStartTime>"
+  "<quality>7</quality><tzOffset>0</tzOffset></Time>";
+
+size_t heap () { return mallinfo2 ().uordblks; }
+
+// memory kept in the pools for reuse
+size_t pooled () {
+  size_t n = http_buffers.count * http_buffers.size
+    + http_targets.count * http_targets.size
+    + se_parsers.count * (se_parsers.size + sizeof (XmlParser));
+#ifdef LINUX_URING
+  n += _reactor->sends.count * _reactor->sends.size;
+#endif
+  return n;
+}
+
+/* run the event loop until n events pass the test and then until no more
+   events are pending, discard event output */
+void run (int n, int (*test) (void *any, int event)) { void *any;
+  int out = dup (1), null = open ("/dev/null", O_WRONLY), event;
+  fflush (stdout); dup2 (null, 1);
+  for (done = 0; done < n; ) {
+    event = event_poll (&any, -1); done += test (any, event);
+  }
+  while ((event = event_poll (&any, 100)) != POLL_TIMEOUT) test (any, event);
+  fflush (stdout); dup2 (out, 1); close (out); close (null);
+}
+
+// read until the port would block so events are not returned again
+int connected (void *any, int event) {
+  switch (event) {
+  case TCP_ACCEPT: case TCP_CONNECT: se_receive (any); return 1;
+  case TCP_PORT: se_receive (any);
+  } return 0;
+}
+
+// the server has started parsing the partial message body
+int started (void *any, int event) { SeConnection *s = any;
+  if (event != TCP_PORT || http_client (s)) return 0;
+  se_receive (s); return s->parser != NULL;
+}
+
+// the client has received the response
+int complete (void *any, int event) { SeConnection *s = any;
+  if (event != TCP_PORT) return 0;
+  if (http_client (s)) return se_receive (s) == HTTP_RESPONSE;
+  if (se_receive (s) == HTTP_POST) {
+    free_se_body (s); http_respond (s, 204);
+  } return 0;
+}
+
+void report (const char *state, size_t base, size_t used) {
+  printf ("  %-10s %6ld bytes/connection, %3d buffers %3d targets "
+	  "%3d parsers borrowed\n", state, (used - base) / (2 * PAIRS),
+	  http_buffers.used, http_targets.used, se_parsers.used);
+}
+
+int main () {
+  char zero[16] = {0}, header[512]; Address addr; Acceptor *a;
+  int i, n, split = 40; size_t base;
+  printf ("SeConnection memory, %d connections\n", 2 * PAIRS);
+  printf ("  SeConnection %ld bytes, borrowed per message %ld bytes\n"
+	  "  (receive buffer %d, target %ld, parser %ld, xml parser %ld)\n",
+	  sizeof (SeConnection), _http_buffer + sizeof (Uri256)
+	  + sizeof (Parser) + sizeof (XmlParser), _http_buffer,
+	  sizeof (Uri256), sizeof (Parser), sizeof (XmlParser));
+  platform_init ();
+  ipv6_address (&addr, zero, 12348);
+  a = net_listen (&addr);
+  base = heap ();
+  for (i = 0; i < PAIRS; i++) {
+    conn_accept (servers[i] = new_conn (0), a, 0);
+    conn_connect (clients[i] = new_conn (1), &addr, 0);
+    if ((i + 1) % BATCH == 0) run (2 * BATCH, connected);
+  }
+  report ("idle", base, heap ());
+  for (i = 0; i < PAIRS; i++) {
+    n = http_post (clients[i], header, "/tm");
+    set_content_length (header, strlen (body));
+    http_write (clients[i], header, n);
+    http_write (clients[i], (char *)body, split);
+  }
+  run (PAIRS, started);
+  report ("in flight", base, heap ());
+  for (i = 0; i < PAIRS; i++)
+    http_write (clients[i], (char *)body + split, strlen (body) - split);
+  run (PAIRS, complete);
+  report ("complete", base, heap () - pooled ());
+  if (http_buffers.used || http_targets.used || se_parsers.used) {
+    printf ("  pooled objects not returned\n"); return 1;
+  } return 0;
+}
@@ -0,0 +1,112 @@
+#include "../se_core.c"
+#include "../list_util.c"
+#include "../time.c"
+#include "../event.c"
+#include "../hash.c"
+#include "../resource.c"
+#include "../retrieve.c"
+
+// the server delays the response to /stuck on the first connection past the
+// request deadline, a second request waits behind it (window of 1); both
+// requests expire, are retried on a second member of the connection pool
+// and answered there, the late response on the first connection arrives
+// without a context
+
+#define DEADLINE 100 // ms
+#define LATE 300 // ms, response delay for /stuck on the first connection
+#define EVENT_RESPOND EVENT_NEW
+
+typedef struct _Pending {
+  struct _Pending *next;
+  HttpConnection *conn;
+  uint64_t due;
+} Pending;
+
+Acceptor *acceptor; Address addr; Queue pending; Timer *timer;
+SeConnection *client; HttpConnection *first;
+int stuck, next, late, timeouts; uint64_t start;
+
+HttpConnection *new_server () {
+  HttpConnection *s = type_alloc (HttpConnection);
+  http_init (s, 0, "text/plain", "text/plain");
+  return conn_accept (s, acceptor, 0);
+}
+
+void server_event (HttpConnection *s) { Pending *p;
+  while (http_receive (s) == HTTP_GET)
+    if (s == first && streq (http_path (s), "/stuck")) {
+      p = malloc (sizeof (Pending)); p->next = NULL;
+      p->conn = s; p->due = clock_ms () + LATE;
+      set_timer_at (timer, p->due); queue_add (&pending, p);
+    } else http_respond (s, 204);
+}
+
+void respond () { Pending *p;
+  while (p = queue_remove (&pending)) {
+    http_respond (p->conn, 204); free (p);
+  }
+}
+
+void client_event (void *conn) { void *context;
+  while (http_receive (conn) == HTTP_RESPONSE) {
+    context = http_context (conn);
+    if (conn == client) {
+      if (context) {
+	printf ("  late response with a context\n"); exit (1);
+      } late++;
+    } else if (context == &stuck) stuck++;
+    else if (context == &next) next++;
+  }
+}
+
+int main () {
+  char zero[16] = {0}; void *any; int t, done = 0;
+  printf ("HTTP request deadline test, %d ms deadline\n", DEADLINE);
+  platform_init (); se_pool (2);
+  ipv6_address (&addr, zero, 12352);
+  timer = add_timer (EVENT_RESPOND);
+  acceptor = net_listen (&addr); first = new_server ();
+  client = se_connect (&addr, 0);
+  http_deadline (client, DEADLINE); http_window (client, 1);
+  start = clock_ms ();
+  http_get (client, "/stuck"); set_request_context (client, &stuck);
+  http_get (client, "/next"); set_request_context (client, &next);
+  while (!done)
+    switch (event_poll (&any, 1000)) {
+    case EVENT_RESPOND: respond (); break;
+    case TCP_ACCEPT: new_server (); break;
+    case TCP_CONNECT: case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (http_client (any)) client_event (any);
+      else server_event (any);
+      done = stuck && next && late;
+      break;
+    case HTTP_TIMEOUT:
+      t = clock_ms () - start; timeouts++;
+      printf ("  requests expired after %d ms\n", t);
+      if (any != client || t < DEADLINE || t >= LATE) {
+	printf ("  unexpected timeout\n"); return 1;
+      } retry_http (any); break;
+    case POLL_TIMEOUT: case TCP_CLOSED: case TCP_TIMEOUT:
+      printf ("  responses not received\n"); return 1;
+    }
+  if (timeouts != 1 || stuck != 1 || next != 1) {
+    printf ("  %d timeouts, %d and %d responses\n", timeouts, stuck, next);
+    return 1;
+  }
+  printf ("  retried requests answered, late response ignored\n");
+  // no deadline remains once the responses are received
+  http_get (client, "/done");
+  while ((t = event_poll (&any, DEADLINE * 2)) != POLL_TIMEOUT)
+    switch (t) {
+    case HTTP_TIMEOUT: printf ("  unexpected timeout\n"); return 1;
+    case TCP_PORT:
+      if (http_client (any)) client_event (any);
+      else server_event (any);
+    }
+  if (http_outstanding (client)) {
+    printf ("  %d requests outstanding\n", http_outstanding (client));
+    return 1;
+  }
+  return 0;
+}
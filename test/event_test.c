@@ -0,0 +1,48 @@
+#include "../se_core.c"
+#include "../time.c"
+#include "../event.c"
+
+// tests the timed event queue, events with millisecond deadlines are
+// returned in order and not early, events due in the same tick share a
+// wakeup, and an event with a time in seconds is returned at the second
+
+#define BURSTS 10 // groups of events with the same deadline
+#define BURST 20 // events per group
+#define EVENT_TEST (EVENT_NEW+20)
+#define EVENT_SECOND (EVENT_NEW+21)
+
+int64_t due[BURSTS * BURST];
+
+int main () {
+  int i, n = 0, wakeups = 0, event; void *any;
+  int64_t late = 0, last = 0, second = se_time () + 1, start;
+  printf ("Event queue test\n");
+  platform_init (); event_init (); start = event_clock ();
+  for (i = 0; i < BURSTS * BURST; i++) {
+    due[i] = start + (1 + i / BURST) * 5000000LL;
+    insert_event_at (&due[i], EVENT_TEST, due[i]);
+  }
+  insert_event (&second, EVENT_SECOND, second);
+  while (n <= BURSTS * BURST) {
+    while (event = next_event (&any)) {
+      int64_t now = event_clock (), t;
+      if (event == EVENT_SECOND) {
+	if ((t = se_time_ns () - second * 1000000000LL) < 0
+	    || t > 20000000) {
+	  printf ("  event at second returned %ld ms late\n", t / 1000000);
+	  return 1;
+	} n++; continue;
+      }
+      if (*(int64_t *)any < last || now < *(int64_t *)any) {
+	printf ("  event returned out of order or early\n"); return 1;
+      } last = *(int64_t *)any; late = max (late, now - last); n++;
+    }
+    if (n <= BURSTS * BURST && event_poll (&any, -1) == EVENT_TIMER)
+      wakeups++;
+  }
+  printf ("  %d events, %d timer wakeups, maximum latency %.2f ms\n",
+	  n, wakeups, late / 1e6);
+  if (wakeups > BURSTS + 1) {
+    printf ("  events due in the same tick were not batched\n"); return 1;
+  } return 0;
+}
@@ -0,0 +1,109 @@
+#include "../se_core.c"
+
+// races connection attempts to a dual-stack host on loopback, the IPv6
+// address is black-holed (a listening socket with a full accept queue drops
+// the SYNs) and IPv4 is served: the IPv4 attempt wins after the attempt
+// delay and the IPv6 attempt is closed; a refused address starts the next
+// attempt at once; every address refused closes the port; every attempt
+// pending times out and the attempts are closed with the port
+
+#define PORT 12358
+#define REFUSED 12359
+#define DELAY 250 // attempt delay in ms
+
+HttpConnection *server, clients[4]; uint64_t start; int event;
+
+void check (int ok, const char *message) {
+  if (!ok) { printf ("  %s\n", message); exit (1); }
+}
+
+// handle events until the client connects, closes or times out
+int wait_client (HttpConnection *c) { void *any;
+  while (1)
+    switch (event = event_poll (&any, 5000)) {
+    case TCP_ACCEPT: case TCP_PORT:
+      if (any == server) {
+	while (http_receive (server) == HTTP_GET) http_respond (server, 204);
+	break;
+      }
+      if (http_receive (any) == HTTP_RESPONSE) return event;
+      break;
+    case TCP_CONNECT:
+      if (any == c) return clock_ms () - start;
+      break;
+    case TCP_WRITABLE: http_flush (any); break;
+    case TCP_CLOSED: case TCP_TIMEOUT:
+      if (any == c) return clock_ms () - start;
+      break;
+    case POLL_TIMEOUT: check (0, "no event");
+    }
+}
+
+// race the addresses, returns the time in ms until the client connects
+int race (HttpConnection *c, Address *addrs, int n, int expect) {
+  int t; http_init (c, 1, "text/plain", "text/plain");
+  start = clock_ms (); conn_connect_any (c, addrs, n, 0);
+  t = wait_client (c);
+  check (event == expect, "unexpected event");
+  return t;
+}
+
+// the attempts closed when the race ended
+int attempts_closed (void *port) { Race *r = ((TcpPort *)port)->race; int i;
+  for (i = 0; i < r->n; i++) if (r->attempt[i].pe.socket >= 0) return 0;
+  return 1;
+}
+
+int main () {
+  char loopback6[16] = {[15] = 1}; Address v6, v4, refused, refused6, addrs[2];
+  Address remote; Acceptor *a; int s, filler, t;
+  printf ("Happy Eyeballs test, %d ms attempt delay\n", DELAY);
+  platform_init (); net_attempt_delay (DELAY);
+  ipv6_address (&v6, loopback6, PORT);
+  ipv4_address (&v4, 0x7f000001, PORT);
+  ipv4_address (&refused, 0x7f000001, REFUSED);
+  ipv6_address (&refused6, loopback6, REFUSED);
+  // black hole, the accept queue of length 1 is filled and never accepted
+  s = socket (AF_INET6, SOCK_STREAM, 0);
+  check (!bind (s, (struct sockaddr *)&v6, v6.length) && !listen (s, 0),
+	 "IPv6 loopback unavailable");
+  filler = socket (AF_INET6, SOCK_STREAM, 0);
+  check (!connect (filler, (struct sockaddr *)&v6, v6.length),
+	 "accept queue not filled");
+  a = net_listen (&v4);
+  server = type_alloc (HttpConnection);
+  http_init (server, 0, "text/plain", "text/plain");
+  conn_accept (server, a, 0);
+
+  addrs[0] = v6; addrs[1] = v4;
+  t = race (&clients[0], addrs, 2, TCP_CONNECT);
+  net_remote (&remote, &clients[0]);
+  printf ("  IPv6 black-holed, IPv4 connected in %d ms\n", t);
+  check (t >= DELAY - 10 && t < DELAY * 4, "IPv4 attempt not raced");
+  check (remote.family == AF_INET, "IPv4 did not win");
+  check (attempts_closed (&clients[0]), "IPv6 attempt not closed");
+  http_get (&clients[0], "/"); wait_client (&clients[0]);
+  check (event == TCP_PORT && http_status (&clients[0]) == 204,
+	 "no response on the winning connection");
+
+  conn_close (server); wait_client (server);
+  http_init (server, 0, "text/plain", "text/plain");
+  conn_accept (server, a, 0);
+  addrs[0] = refused; addrs[1] = v4;
+  t = race (&clients[1], addrs, 2, TCP_CONNECT);
+  printf ("  first address refused, connected in %d ms\n", t);
+  check (t < DELAY, "next attempt not started when refused");
+
+  addrs[0] = refused; addrs[1] = refused6;
+  t = race (&clients[2], addrs, 2, TCP_CLOSED);
+  printf ("  every address refused, closed in %d ms\n", t);
+  check (t < DELAY, "port not closed");
+
+  net_timeout (1);
+  addrs[0] = v6; addrs[1] = refused;
+  t = race (&clients[3], addrs, 2, TCP_TIMEOUT);
+  printf ("  attempt pending, timed out in %d ms\n", t);
+  conn_close (&clients[3]);
+  check (attempts_closed (&clients[3]), "attempts not closed");
+  return 0;
+}
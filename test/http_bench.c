@@ -0,0 +1,67 @@
+#include "../se_core.c"
+
+// measures the cost of formatting a GET request header, the per connection
+// template and cached Date line compared with formatting every field and
+// getting the remote address for each request
+
+#define REQUESTS 1000000
+
+HttpConnection *client, *server;
+
+double elapsed (struct timespec *start) { struct timespec end;
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9
+    + (end.tv_nsec - start->tv_nsec);
+}
+
+// request header formatted without the template
+int http_request_format (void *conn, char *buffer, const char *uri,
+			 int method) {
+  HttpConnection *c = conn; Address addr;
+  const char *name = http_methods[method]; time_t now = time (NULL);
+  struct tm tm = *gmtime (&now);
+  int n = sprintf (buffer, "%s %s %s\r\n", name, uri, c->version);
+  n += strftime (buffer+n, 1024, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+  n += sprintf (buffer+n, "Host: ");
+  n += write_address_port (buffer+n, net_remote (&addr, c));
+  n += sprintf (buffer+n, "\r\nAccept: %s\r\n", c->accept);
+  queue_request (conn, method, uri); return n;
+}
+
+double bench (const char *name, int template) {
+  struct timespec start; char buffer[256]; int i; double ns;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < REQUESTS; i++) {
+    if (template) http_request (client, buffer, "/dcap/edev/3/fsa", HTTP_GET);
+    else http_request_format (client, buffer, "/dcap/edev/3/fsa", HTTP_GET);
+    free (dequeue_request (client));
+  }
+  printf ("  %-10s %6.1f ns/request\n", name, ns = elapsed (&start) / REQUESTS);
+  return ns;
+}
+
+int main () {
+  char zero[16] = {0}, a[256], b[256]; Address addr; Acceptor *l;
+  int connected = 0, n, m; void *any; double format, template;
+  printf ("HTTP request header benchmark, %d requests\n", REQUESTS);
+  platform_init ();
+  ipv6_address (&addr, zero, 12348);
+  client = type_alloc (HttpConnection); server = type_alloc (HttpConnection);
+  http_init (client, 1, "application/sep+xml; level=-S1", "text/plain");
+  http_init (server, 0, "text/plain", "text/plain");
+  l = net_listen (&addr);
+  conn_accept (server, l, 0); conn_connect (client, &addr, 0);
+  while (connected < 2)
+    switch (event_poll (&any, -1)) {
+    case TCP_ACCEPT: case TCP_CONNECT: connected++; break;
+    case TCP_PORT: http_receive (any); // read until a read would block
+    }
+  n = http_request_format (client, a, "/dcap", HTTP_GET);
+  m = http_request (client, b, "/dcap", HTTP_GET);
+  if (n != m || memcmp (a, b, n)) {
+    printf ("  request headers differ:\n%.*s%.*s", n, a, m, b); return 1;
+  }
+  format = bench ("format", 0); template = bench ("template", 1);
+  printf ("  speedup %.1fx\n", format / template);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "../se_core.c"
+
+// measures the latency of large POST requests through HttpConnections over
+// the loopback interface, the request body is larger than the socket
+// buffers so the request is completed by flushing the send queue on
+// TCP_WRITABLE events, the Accept header line is longer than the initial
+// receive buffer
+
+#define BODY (8 << 20) // request body size
+#define ROUNDS 20
+#define ACCEPT 6000 // Accept header length
+
+HttpConnection *client, *server;
+char *body, range[ACCEPT+1];
+long received; int rounds, started;
+double total, worst; struct timespec start;
+
+double elapsed (struct timespec *start) { struct timespec end;
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e3
+    + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void post () { char header[ACCEPT+512]; struct iovec iov[2];
+  int n = http_request (client, header, "/upload", HTTP_POST);
+  n += sprintf (header+n, "Content-Type: text/plain\r\n"
+		"Content-Length: %d\r\n\r\n", BODY);
+  iov[0].iov_base = header; iov[0].iov_len = n;
+  iov[1].iov_base = body; iov[1].iov_len = BODY;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  http_writev (client, iov, 2, 0);
+}
+
+void server_event () { char *data; int length;
+  if (http_receive (server) != HTTP_POST) return;
+  if (!started++ && strlen (http_range (server)) != ACCEPT) {
+    printf ("  Accept header truncated\n"); exit (1);
+  }
+  while ((data = http_data (server, &length)) && length) {
+    received += length; http_rebuffer (server, data + length);
+  }
+  if (http_complete (server)) {
+    if (received != BODY) {
+      printf ("  received %ld bytes, expected %d\n", received, BODY);
+      exit (1);
+    } received = started = 0; http_respond (server, 204);
+  }
+}
+
+void client_event () { double ms;
+  if (http_receive (client) != HTTP_RESPONSE) return;
+  if (http_status (client) != 204) {
+    printf ("  unexpected status %d\n", http_status (client)); exit (1);
+  }
+  ms = elapsed (&start); total += ms; worst = max (worst, ms);
+  if (++rounds < ROUNDS) post ();
+}
+
+int main () {
+  char zero[16] = {0}; Address addr; Acceptor *a;
+  int connected = 0; void *any;
+  printf ("HttpConnection POST latency, %d x %d byte requests\n",
+	  ROUNDS, BODY);
+  platform_init ();
+  ipv6_address (&addr, zero, 12347);
+  client = type_alloc (HttpConnection); server = type_alloc (HttpConnection);
+  memset (range, 'x', ACCEPT);
+  http_init (client, 1, range, "text/plain");
+  http_init (server, 0, "text/plain", "text/plain");
+  a = net_listen (&addr);
+  conn_accept (server, a, 0); conn_connect (client, &addr, 0);
+  memset (body = malloc (BODY), 'x', BODY);
+  while (connected < 2 || rounds < ROUNDS) {
+    switch (event_poll (&any, -1)) {
+    case TCP_ACCEPT: case TCP_CONNECT:
+      if (++connected == 2) post ();
+      break;
+    case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (any == server) server_event ();
+      else client_event ();
+      break;
+    case TCP_CLOSED: case TCP_TIMEOUT:
+      printf ("  connection lost\n"); return 1;
+    }
+  }
+  printf ("  average %8.2f ms\n", total / ROUNDS);
+  printf ("  maximum %8.2f ms\n", worst);
+  return 0;
+}
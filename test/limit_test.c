@@ -0,0 +1,97 @@
+#include "../se_core.c"
+
+// sends a burst of GET requests on a connection with a request rate limit,
+// the requests are spaced by the limit once the burst is spent; the server
+// then responds 503 with Retry-After (delta-seconds) and the next request is
+// held for the time given, a 429 response with an HTTP-date is parsed
+
+#define RATE 20 // requests per second
+#define BURST 2
+#define REQUESTS 10
+
+HttpConnection *client, *server;
+int responses; uint64_t start, received;
+
+void respond_after (int status, const char *reason, const char *retry) {
+  char buffer[256]; int n = http_status_line (buffer, status, reason);
+  n += sprintf (buffer+n, "Retry-After: %s\r\nContent-Length: 0\r\n\r\n",
+		retry);
+  http_write (server, buffer, n);
+}
+
+void server_event () { char date[64]; time_t t;
+  while (http_receive (server) == HTTP_GET) {
+    if (streq (http_path (server), "/busy"))
+      respond_after (503, "Service Unavailable", "1");
+    else if (streq (http_path (server), "/date")) {
+      t = time (NULL) + 2;
+      strftime (date, sizeof (date), "%a, %d %b %Y %H:%M:%S GMT",
+		gmtime (&t));
+      respond_after (429, "Too Many Requests", date);
+    } else {
+      if (streq (http_path (server), "/after")) received = clock_ms ();
+      http_respond (server, 204);
+    }
+  }
+}
+
+// wait for the response to a request, returns the time since start in ms
+int wait_for (const char *path) { void *any;
+  while (1)
+    switch (event_poll (&any, 5000)) {
+    case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (any == server) { server_event (); break; }
+      while (http_receive (client) == HTTP_RESPONSE) {
+	responses++;
+	if (streq (http_path (client), path)) return clock_ms () - start;
+      } break;
+    case POLL_TIMEOUT: case TCP_CLOSED: case TCP_TIMEOUT:
+      printf ("  response to %s not received\n", path); exit (1);
+    }
+}
+
+void check (int ok, const char *message) {
+  if (!ok) { printf ("  %s\n", message); exit (1); }
+}
+
+int main () {
+  char zero[16] = {0}, uri[16]; Address addr; Acceptor *a;
+  int connected = 0, i, t, expect; void *any;
+  printf ("HTTP request rate limit test, %d requests per second\n", RATE);
+  platform_init (); ipv6_address (&addr, zero, 12353);
+  client = type_alloc (HttpConnection); server = type_alloc (HttpConnection);
+  http_init (client, 1, "text/plain", "text/plain");
+  http_init (server, 0, "text/plain", "text/plain");
+  http_limit (client, http_limit_new (RATE, BURST));
+  a = net_listen (&addr);
+  conn_accept (server, a, 0); conn_connect (client, &addr, 0);
+  while (connected < 2)
+    switch (event_poll (&any, 5000)) {
+    case TCP_ACCEPT: case TCP_CONNECT: connected++; break;
+    case TCP_PORT: http_receive (any); break; // read until it would block
+    case POLL_TIMEOUT: printf ("  not connected\n"); return 1;
+    }
+  start = clock_ms (); http_window (client, 0);
+  for (i = 0; i < REQUESTS; i++) {
+    sprintf (uri, "/%d", i); http_get (client, uri);
+  }
+  sprintf (uri, "/%d", REQUESTS - 1); t = wait_for (uri);
+  expect = (REQUESTS - BURST) * 1000 / RATE;
+  printf ("  %d requests in %d ms, %d ms expected\n", responses, t, expect);
+  check (responses == REQUESTS, "responses missing");
+  check (t >= expect - 50 && t < expect * 2, "request rate not limited");
+  http_get (client, "/busy"); wait_for ("/busy");
+  check (http_status (client) == 503 && http_retry_after (client) == 1,
+	 "Retry-After not received");
+  start = clock_ms (); http_get (client, "/after"); wait_for ("/after");
+  t = received - start;
+  printf ("  request held for %d ms after Retry-After: 1\n", t);
+  check (t >= 990, "request not held");
+  http_get (client, "/date"); wait_for ("/date");
+  t = http_retry_after (client);
+  printf ("  Retry-After HTTP-date is %d s from now\n", t);
+  check (http_status (client) == 429 && t >= 1 && t <= 2,
+	 "Retry-After HTTP-date not parsed");
+  return 0;
+}
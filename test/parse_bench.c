@@ -0,0 +1,121 @@
+#include "../se_core.c"
+
+// measures HTTP header parsing in headers per second on IEEE 2030.5
+// responses, splitting lines and matching header names byte by byte (as the
+// parser did before) is compared with the vector scanner and header name
+// hash, then complete responses are parsed by http_receive
+
+#define ROUNDS 200000
+
+const char * const responses[] = {
+  "HTTP/1.1 200 OK\r\n"
+  "Date: Tue, 14 May 2024 17:02:11 GMT\r\n"
+  "Server: IEEE2030.5-Server/2.1\r\n"
+  "Content-Type: application/sep+xml\r\n"
+  "Content-Length: 412\r\n"
+  "Cache-Control: no-cache, no-store\r\n"
+  "Connection: keep-alive\r\n\r\n",
+  "HTTP/1.1 200 OK\r\n"
+  "Date: Tue, 14 May 2024 17:02:12 GMT\r\n"
+  "Server: IEEE2030.5-Server/2.1\r\n"
+  "Content-Type: application/sep+xml; level=-S1\r\n"
+  "Transfer-Encoding: chunked\r\n"
+  "Vary: Accept\r\n"
+  "Connection: keep-alive\r\n\r\n",
+  "HTTP/1.1 201 Created\r\n"
+  "Date: Tue, 14 May 2024 17:02:13 GMT\r\n"
+  "Server: IEEE2030.5-Server/2.1\r\n"
+  "Location: /edev/3/der/1/ders\r\n"
+  "Content-Length: 0\r\n\r\n",
+  "HTTP/1.1 204 No Content\r\n"
+  "Date: Tue, 14 May 2024 17:02:14 GMT\r\n"
+  "Server: IEEE2030.5-Server/2.1\r\n"
+  "Location: /mup/2/mr/1/rs/1/r\r\n\r\n",
+  "HTTP/1.1 301 Moved Permanently\r\n"
+  "Date: Tue, 14 May 2024 17:02:15 GMT\r\n"
+  "Server: IEEE2030.5-Server/2.1\r\n"
+  "Location: https://[2001:db8::1]:443/dcap\r\n"
+  "Content-Type: application/sep-exi\r\n"
+  "Content-Length: 0\r\n\r\n"
+};
+#define RESPONSES (sizeof (responses) / sizeof (char *))
+
+char buffer[1024]; int lengths[RESPONSES], known;
+
+double elapsed (struct timespec *start) { struct timespec end;
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9
+    + (end.tv_nsec - start->tv_nsec);
+}
+
+// byte by byte line and colon search, lower case header names
+int parse_scalar (char *data) {
+  const char * const names[] = {"host", "accept", "content-type",
+				"content-length", "connection", "location",
+				"transfer-encoding"};
+  int n = 0; char *cr, *header;
+  while (1) {
+    for (cr = data; *cr && !(cr[0] == '\r' && cr[1] == '\n'); cr++);
+    if (!*cr || cr == data) return n - 1;
+    *cr = '\0';
+    if (n++) {
+      for (header = data; *data && *data != ':'; data++);
+      *data = '\0';
+      known += string_index (to_lower (header), names, 7) < 7;
+    } data = cr + 2;
+  }
+}
+
+// vector scanner and header name hash
+int parse_vector (char *data) {
+  int n = 0; char *cr, *header;
+  while (*(cr = scan2 (data, '\r', '\r')) && cr[1] == '\n' && cr != data) {
+    *cr = '\0';
+    if (n++ && token_colon (&header, data))
+      known += header_index (header) < HTTP_HEADERS;
+    data = cr + 2;
+  } return n - 1;
+}
+
+double bench (const char *name, int (*parse) (char *)) {
+  struct timespec start; int i, j, headers = 0; double ns;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < ROUNDS; i++)
+    for (j = 0; j < RESPONSES; j++) {
+      memcpy (buffer, responses[j], lengths[j] + 1);
+      headers += parse (buffer);
+    }
+  ns = elapsed (&start);
+  printf ("  %-12s %6.1f M headers/s, %d known\n",
+	  name, headers / ns * 1e3, known / ROUNDS);
+  known = 0;
+  return ns;
+}
+
+int main () {
+  HttpConnection *c; struct timespec start; int i, j, headers = 0;
+  double scalar, vector;
+  printf ("HTTP header parsing benchmark, %d responses\n", (int)RESPONSES);
+  platform_init ();
+  for (j = 0; j < RESPONSES; j++) lengths[j] = strlen (responses[j]);
+  scalar = bench ("byte", parse_scalar);
+  vector = bench ("vector", parse_vector);
+  printf ("  speedup %.1fx\n", scalar / vector);
+  c = type_alloc (HttpConnection);
+  http_init (c, 1, "application/sep+xml", "application/sep+xml");
+  http_acquire (c);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < ROUNDS; i++)
+    for (j = 0; j < RESPONSES; j++) {
+      memcpy (c->buffer, responses[j], lengths[j] + 1);
+      c->data = c->buffer; c->length = lengths[j]; c->state = HTTP_START;
+      queue_request (c, HTTP_GET, "/edev");
+      if (http_receive (c) != HTTP_RESPONSE) {
+	printf ("  response %d not parsed\n", j); return 1;
+      }
+      headers += __builtin_popcount (c->header & 255);
+    }
+  printf ("  http_receive %6.1f M known headers/s\n",
+	  headers / elapsed (&start) * 1e3);
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include "../se_core.c"
+#include "../list_util.c"
+#include "../time.c"
+#include "../event.c"
+#include "../hash.c"
+#include "../resource.c"
+#include "../retrieve.c"
+
+// retrieves resources with pipelined GET requests from a server that delays
+// each response by a round trip time, first without pipelining and then
+// with the default window, the server checks that no more requests than the
+// window are in flight; finally the server closes the connection part way
+// and the client replays the GET requests in order on a new connection;
+// last a list is retrieved in pages from a server that returns a short page
+// from the middle of the list, the items missing from it are requested again
+
+#define REQUESTS 16
+#define RTT 20 // ms
+#define CLOSE_AFTER 5 // responses before the server closes in the last round
+#define EVENT_RESPOND EVENT_NEW
+#define LIST_ALL 40
+#define LIST_PAGE 10 // the server's page size
+#define SHORT_START 20 // start of the page the server returns short
+#define SHORT_RESULTS 5
+
+typedef struct _Pending {
+  struct _Pending *next;
+  uint64_t due;
+} Pending;
+
+HttpConnection *client, *server; Acceptor *acceptor; Address addr;
+Queue pending; Timer *timer;
+int received, responded, most, next, closing, replays;
+
+HttpConnection *new_server () {
+  HttpConnection *s = type_alloc (HttpConnection);
+  http_init (s, 0, "text/plain", "text/plain");
+  return conn_accept (s, acceptor, 0);
+}
+
+void server_event (HttpConnection *s) { Pending *p;
+  if (s != server) return;
+  while (http_receive (s) == HTTP_GET) {
+    p = malloc (sizeof (Pending)); p->next = NULL;
+    p->due = clock_ms () + RTT; received++;
+    if (queue_empty (&pending)) set_timer_at (timer, p->due);
+    queue_add (&pending, p);
+    most = max (most, received - responded);
+  }
+}
+
+void respond () { Pending *p; uint64_t now = clock_ms ();
+  while ((p = queue_peek (&pending)) && p->due <= now) {
+    queue_remove (&pending); free (p);
+    http_respond (server, 204); responded++;
+    if (closing && responded == CLOSE_AFTER) {
+      responded += list_length (pending.first); // dropped
+      queue_free (&pending); http_close (server);
+      server = new_server (); return;
+    }
+  }
+  if (p) set_timer_at (timer, p->due);
+}
+
+int client_event () { char uri[32];
+  while (http_receive (client) == HTTP_RESPONSE) {
+    sprintf (uri, "/r/%d", next++);
+    if (http_status (client) != 204 || !streq (http_path (client), uri)) {
+      printf ("  response %s out of order\n", uri); exit (1);
+    }
+  } return next == REQUESTS;
+}
+
+double retrieve (int w) {
+  struct timespec start, end; char uri[32]; void *any; int i, done = 0;
+  http_window (client, w);
+  received = responded = most = next = 0;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < REQUESTS; i++) {
+    sprintf (uri, "/r/%d", i); http_get (client, uri);
+  }
+  while (!done) {
+    switch (event_poll (&any, -1)) {
+    case EVENT_RESPOND: respond (); break;
+    case TCP_ACCEPT: break;
+    case TCP_CONNECT: http_flush (any); break;
+    case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (any == client) done = client_event ();
+      else server_event (any);
+      break;
+    case TCP_CLOSED:
+      if (any != client) break;
+      printf ("  connection closed after %d responses, replaying\n", next);
+      replays++; free_list (http_replay (client));
+      conn_connect (client, &addr, 0);
+      break;
+    case TCP_TIMEOUT:
+      printf ("  connection timed out\n"); exit (1);
+    }
+  }
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  if (w && most > w) {
+    printf ("  %d requests in flight, window %d\n", most, w); exit (1);
+  }
+  return (end.tv_sec - start.tv_sec) * 1e3
+    + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+SE_EndDevice_t devices[LIST_ALL]; int list_done, gap;
+
+void list_serve (void *conn) { SE_EndDeviceList_t list = {0};
+  int start, limit, i;
+  while (se_receive (conn) == HTTP_GET) {
+    page_query (conn, &start, &limit);
+    if (start == SHORT_START + SHORT_RESULTS) gap++;
+    list.all = LIST_ALL; list.href = "/edev";
+    list.results = start == SHORT_START? SHORT_RESULTS
+      : min (min (limit? limit : LIST_PAGE, LIST_PAGE), LIST_ALL - start);
+    for (i = start + list.results - 1; i >= start; i--)
+      list.EndDevice = list_insert (list.EndDevice, &devices[i]);
+    se_respond (conn, 200, &list, SE_EndDeviceList);
+    free_list (list.EndDevice); list.EndDevice = NULL;
+  }
+}
+
+void list_dep (Stub *s) {}
+
+void list_complete (Stub *s) { list_done = 1; }
+
+int retrieve_list () {
+  char zero[16] = {0}; Address addr; Acceptor *a; SeConnection *c;
+  Stub *s; void *any; int i, out, failed = 0;
+  ipv6_address (&addr, zero, 12360);
+  resource_init (); event_init ();
+  for (i = 0; i < LIST_ALL; i++) {
+    char href[16]; sprintf (href, "/edev/%d", i);
+    devices[i].href = strdup (href);
+  }
+  a = net_listen (&addr); se_accept (a, 0);
+  c = se_connect (&addr, 0);
+  fflush (stdout); out = dup (1); // responses are logged by process_http
+  dup2 (open ("/dev/null", O_WRONLY), 1);
+  s = get_resource (c, SE_EndDeviceList, "/edev", LIST_ALL);
+  s->completion = list_complete;
+  while (!list_done && !failed) {
+    if (next_event (&any) == RETRIEVE_FAIL) { failed = 1; break; }
+    switch (event_poll (&any, 1000)) {
+    case TCP_ACCEPT: se_accept (a, 0); break;
+    case TCP_CONNECT: case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (http_client (any)) process_http (any, list_dep);
+      else list_serve (any);
+      break;
+    case POLL_TIMEOUT: case TCP_CLOSED: case TCP_TIMEOUT: failed = 1;
+    }
+  }
+  fflush (stdout); dup2 (out, 1);
+  if (failed) printf ("  list retrieval failed\n");
+  else if (gap != 1) printf ("  short page requested again %d times\n", gap);
+  else printf ("  %d items retrieved with a short page\n",
+	       list_length (s->reqs));
+  return failed || gap != 1 || list_length (s->reqs) != LIST_ALL;
+}
+
+int main () {
+  char zero[16] = {0}; void *any; int connected = 0; double serial, pipelined;
+  printf ("HTTP pipelining test, %d requests, %d ms round trip\n",
+	  REQUESTS, RTT);
+  platform_init ();
+  ipv6_address (&addr, zero, 12349);
+  timer = add_timer (EVENT_RESPOND);
+  client = type_alloc (HttpConnection);
+  http_init (client, 1, "text/plain", "text/plain");
+  acceptor = net_listen (&addr); server = new_server ();
+  conn_connect (client, &addr, 0);
+  while (connected < 2)
+    switch (event_poll (&any, -1)) {
+    case TCP_ACCEPT: case TCP_CONNECT: connected++; break;
+    case TCP_PORT: http_receive (any); // read until a read would block
+    }
+  serial = retrieve (1);
+  printf ("  window 1  %6.1f ms, %d requests in flight\n", serial, most);
+  pipelined = retrieve (_http_window);
+  printf ("  window %d  %6.1f ms, %d requests in flight\n",
+	  _http_window, pipelined, most);
+  if (pipelined * 2 > serial) {
+    printf ("  requests were not pipelined\n"); return 1;
+  }
+  closing = 1; retrieve (_http_window);
+  if (replays != 1) {
+    printf ("  requests were not replayed\n"); return 1;
+  }
+  printf ("  %d requests received by the server\n", received);
+  return retrieve_list ();
+}
@@ -0,0 +1,95 @@
+#include "../se_core.c"
+
+// requests resources from a server that delays the response to /slow, a
+// request made while /slow is outstanding is sent on a second member of the
+// connection pool and is not blocked by the slow response, idle members are
+// reused and the pool is not grown beyond its size
+
+#define SLOW 200 // ms
+#define EVENT_RESPOND EVENT_NEW
+
+typedef struct _Pending {
+  struct _Pending *next;
+  HttpConnection *conn;
+  uint64_t due;
+} Pending;
+
+Acceptor *acceptor; Address addr; Queue pending; Timer *timer;
+SeConnection *client;
+int servers; uint64_t start;
+
+HttpConnection *new_server () {
+  HttpConnection *s = type_alloc (HttpConnection);
+  http_init (s, 0, "text/plain", "text/plain");
+  return conn_accept (s, acceptor, 0);
+}
+
+void server_event (HttpConnection *s) { Pending *p;
+  while (http_receive (s) == HTTP_GET)
+    if (streq (http_path (s), "/slow")) {
+      p = malloc (sizeof (Pending)); p->next = NULL;
+      p->conn = s; p->due = clock_ms () + SLOW;
+      if (queue_empty (&pending)) set_timer_at (timer, p->due);
+      queue_add (&pending, p);
+    } else http_respond (s, 204);
+}
+
+void respond () { Pending *p; uint64_t now = clock_ms ();
+  while ((p = queue_peek (&pending)) && p->due <= now) {
+    queue_remove (&pending); http_respond (p->conn, 204); free (p);
+  }
+  if (p) set_timer_at (timer, p->due);
+}
+
+// wait for the response to a request, returns the time since start in ms
+int wait_for (const char *path) { void *any;
+  while (1)
+    switch (event_poll (&any, -1)) {
+    case EVENT_RESPOND: respond (); break;
+    case TCP_ACCEPT: servers++; new_server (); break;
+    case TCP_CONNECT: case TCP_WRITABLE: http_flush (any); break;
+    case TCP_PORT:
+      if (!http_client (any)) { server_event (any); break; }
+      while (http_receive (any) == HTTP_RESPONSE)
+	if (streq (http_path (any), path)) return clock_ms () - start;
+      break;
+    case TCP_CLOSED: case TCP_TIMEOUT:
+      printf ("  connection lost\n"); exit (1);
+    }
+}
+
+void *get (const char *path) { void *m = se_member (client);
+  http_get (m, path); return m;
+}
+
+void check (int ok, const char *message) {
+  if (!ok) { printf ("  %s\n", message); exit (1); }
+}
+
+int main () {
+  char zero[16] = {0}; void *slow, *fast; int t;
+  printf ("Connection pool test, %d ms response delay\n", SLOW);
+  platform_init (); se_pool (2);
+  ipv6_address (&addr, zero, 12351);
+  timer = add_timer (EVENT_RESPOND);
+  acceptor = net_listen (&addr); new_server ();
+  client = se_connect (&addr, 0); start = clock_ms ();
+  check ((slow = get ("/slow")) == client, "first request not on the primary");
+  check ((fast = get ("/fast/0")) != slow, "pool not grown");
+  check (se_primary (fast) == client, "member not in the pool");
+  t = wait_for ("/fast/0");
+  printf ("  /fast/0 received after %d ms\n", t);
+  check (t < SLOW / 2, "request blocked by a slow response");
+  check (get ("/fast/1") == fast, "idle member not reused");
+  wait_for ("/fast/1");
+  check (get ("/fast/2") == fast, "idle member not reused");
+  wait_for ("/fast/2");
+  t = wait_for ("/slow");
+  printf ("  /slow received after %d ms\n", t);
+  check (get ("/slow") == client && get ("/slow") == fast
+	 && get ("/fast/3") && find_conn (&addr) == client, "pool selection");
+  wait_for ("/fast/3");
+  check (servers == 2, "more connections than the pool size");
+  printf ("  %d connections accepted\n", servers);
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include "../pack.c"
+#include "../util.c"
+#include "../list.c"
+#include "../queue.c"
+#include "../pool.c"
+#include "../platform.c"
+
+// posts events to a Reactor from several threads, the events from each
+// thread are returned by event_poll in order, reports the latency of events
+// posted while the Reactor is waiting
+
+#define THREADS 4
+#define POSTS 20000 // events posted by each thread
+#define BURST 10 // events posted between pauses
+#define EVENT_POST EVENT_NEW
+
+typedef struct {
+  int thread, seq; uint64_t sent;
+} Message;
+
+Reactor *reactor;
+
+uint64_t clock_ns () { struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void *producer (void *arg) {
+  int i, thread = (long)arg; Message *m;
+  struct timespec pause = {0, 100000}; // 0.1 ms
+  for (i = 0; i < POSTS; i++) {
+    m = malloc (sizeof (Message));
+    m->thread = thread; m->seq = i; m->sent = clock_ns ();
+    reactor_post (reactor, m, EVENT_POST);
+    if (i % BURST == 0) nanosleep (&pause, NULL); // let the reactor wait
+  } return NULL;
+}
+
+int main () {
+  pthread_t threads[THREADS]; int next[THREADS] = {0}, n = 0;
+  long i; uint64_t total = 0, worst = 0, latency; void *any; Message *m;
+  printf ("Reactor post test, %d threads x %d events\n", THREADS, POSTS);
+  platform_init (); reactor = reactor_current ();
+  for (i = 0; i < THREADS; i++)
+    pthread_create (&threads[i], NULL, producer, (void *)i);
+  while (n < THREADS * POSTS) {
+    if (event_poll (&any, 1000) != EVENT_POST) {
+      printf ("  events lost, %d received\n", n); return 1;
+    } m = any;
+    if (m->seq != next[m->thread]++) {
+      printf ("  thread %d events out of order\n", m->thread); return 1;
+    } latency = clock_ns () - m->sent;
+    total += latency; worst = max (worst, latency); free (m); n++;
+  }
+  for (i = 0; i < THREADS; i++) pthread_join (threads[i], NULL);
+  printf ("  %d events, average latency %.1f us, maximum %.1f us\n",
+	  n, total / 1e3 / n, worst / 1e3);
+  return 0;
+}
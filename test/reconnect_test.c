@@ -0,0 +1,96 @@
+#include "../se_core.c"
+
+// clients to several servers (loopback addresses 127.0.0.x) are closed when
+// idle and opened again by the next request; then the server closes every
+// connection at once, as a restart would, and the clients reconnect after a
+// jittered backoff rather than at the same instant
+
+#define CLIENTS 20
+#define PORT 12360
+
+SeConnection *clients[CLIENTS];
+int responses, idle_closed; uint64_t first, last;
+
+void server_event (void *conn) {
+  while (http_receive (conn) == HTTP_GET) http_respond (conn, 204);
+}
+
+// handle events until the number of responses is received
+void poll_responses (int n) { void *any; uint64_t now;
+  while (responses < n)
+    switch (event_poll (&any, 5000)) {
+    case TCP_ACCEPT: case TCP_PORT:
+      if (!http_client (any)) { server_event (any); break; }
+      while (se_receive (any) == HTTP_RESPONSE) {
+	now = clock_ms (); if (!first) first = now;
+	last = now; responses++;
+      } break;
+    case TCP_CONNECT: case TCP_WRITABLE: http_flush (any); break;
+    case TCP_CLOSED: case TCP_TIMEOUT:
+      if (!http_client (any)) { se_recycle (any); break; }
+      if (se_closed (any)) idle_closed++; // requests are replayed
+      break;
+    case SE_IDLE: se_idle (any); break;
+    case SE_RECONNECT: se_redial (any); break;
+    case POLL_TIMEOUT:
+      printf ("  %d of %d responses\n", responses, n); exit (1);
+    }
+}
+
+void check (int ok, const char *message) {
+  if (!ok) { printf ("  %s\n", message); exit (1); }
+}
+
+// request from every client
+void get_all () { int i;
+  for (i = 0; i < CLIENTS; i++) http_get (se_member (clients[i]), "/");
+}
+
+int main () {
+  Address local, addr; Acceptor *a; SeStats *s = se_stats ();
+  SeConnection *c; int i, closed = 0; uint64_t start;
+  printf ("Reconnect test, %d clients\n", CLIENTS);
+  platform_init (); srand (time (NULL));
+  ipv4_address (&local, 0, PORT); a = net_listen (&local);
+  se_accept_pool (a, 0, CLIENTS); se_pool (1); se_idle_timeout (1);
+  for (i = 0; i < CLIENTS; i++) {
+    ipv4_address (&addr, 0x7f000001 + i, PORT);
+    clients[i] = se_connect (&addr, 0);
+  }
+  get_all (); poll_responses (CLIENTS); start = clock_ms ();
+  while (idle_closed < CLIENTS) { void *any;
+    switch (event_poll (&any, 3000)) {
+    case TCP_PORT: // a server port sees the client close when read
+      if (!http_client (any)) server_event (any);
+      break;
+    case TCP_CLOSED:
+      if (!http_client (any)) se_recycle (any);
+      else if (se_closed (any)) idle_closed++;
+      break;
+    case SE_IDLE: se_idle (any); break;
+    case POLL_TIMEOUT: check (0, "idle connections not closed");
+    }
+  }
+  printf ("  %d idle connections closed after %d ms\n", (int)s->reaped,
+	  (int)(clock_ms () - start));
+  check (s->reaped == CLIENTS, "idle connections not counted");
+  responses = 0; get_all (); poll_responses (CLIENTS);
+  check (s->reopened == CLIENTS, "idle connections not opened again");
+  printf ("  %d connections opened again on demand\n", (int)s->reopened);
+
+  // restart, the server closes every connection
+  for (c = connections; c; c = c->next)
+    if (!http_client (c) && net_status (c) == Connected) {
+      conn_close (c); closed++;
+    }
+  start = clock_ms (); get_all ();
+  responses = 0; first = 0; poll_responses (CLIENTS);
+  printf ("  server closed %d connections, reconnected from %d to %d ms\n",
+	  closed, (int)(first - start), (int)(last - start));
+  print_se_stats ();
+  check (s->closed == CLIENTS && s->reconnects == CLIENTS,
+	 "reconnects not counted");
+  check (first - start >= 490, "reconnected without a backoff");
+  check (last - first >= 100, "reconnects not spread");
+  return 0;
+}
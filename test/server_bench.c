@@ -0,0 +1,126 @@
+#include "../se_core.c"
+#include "../hash.c"
+#include "../resource.c"
+#include "../se_server.c"
+
+// serves resources from the Resource database and a route with a handler,
+// checks the responses (object type, 404, 405, 201 from a handler and the
+// longest matching prefix), then measures the number of GET requests per
+// second served over a loopback connection with pipelined requests
+
+#define REQUESTS 50000
+#define WINDOW 32
+
+Acceptor *acceptor; SeConnection *client; HttpConnection *raw;
+int status, type, responses, receiving;
+
+void *new_server () { return se_accept (acceptor, 0); }
+
+int time_handler (void *conn, int method, char *path, void *obj, int type) {
+  SE_Time_t tm = {0};
+  if (obj) free_se_object (obj, type);
+  if (method != HTTP_GET) return 405;
+  tm.href = path; tm.currentTime = time (NULL);
+  se_respond (conn, 200, &tm, SE_Time); return 0;
+}
+
+int edev_handler (void *conn, int method, char *path, void *obj, int type) {
+  if (obj) free_se_object (obj, type);
+  if (method != HTTP_POST || !streq (path, "/edev")) return 404;
+  http_created (conn, "/edev/1"); return 0;
+}
+
+// read the bodies of the responses to the raw client
+void raw_event () { char *data; int length;
+  while (1) {
+    if (!receiving) {
+      if (http_receive (raw) != HTTP_RESPONSE) return;
+      if (http_status (raw) != 200) {
+	printf ("  status %d\n", http_status (raw)); exit (1);
+      } receiving = 1;
+    }
+    while ((data = http_data (raw, &length)) && length)
+      http_rebuffer (raw, data + length);
+    if (!http_complete (raw)) return;
+    receiving = 0; responses++;
+  }
+}
+
+// handle events until the condition holds
+#define poll_until(condition) { void *any;				\
+    while (!(condition))						\
+      switch (event_poll (&any, 5000)) {				\
+      case TCP_ACCEPT: new_server (); break;				\
+      case TCP_CONNECT: case TCP_WRITABLE: http_flush (any); break;	\
+      case TCP_PORT:							\
+	if (!http_client (any)) se_serve (any);				\
+	else if (any == raw) raw_event ();				\
+	else if (se_receive (any) == HTTP_RESPONSE) {			\
+	  void *obj = se_body (any, &type);				\
+	  if (obj) free_se_object (obj, type);				\
+	  else type = -1;						\
+	  status = http_status (any);					\
+	} break;							\
+      case POLL_TIMEOUT: case TCP_CLOSED: case TCP_TIMEOUT:		\
+	printf ("  connection lost\n"); exit (1);			\
+      }									\
+  }
+
+void check (const char *path, int method, int expect, int expect_type) {
+  SE_Time_t tm = {0};
+  status = 0; type = -1;
+  if (method == HTTP_GET) http_get (client, path);
+  else se_send (client, &tm, SE_Time, (char *)path, method);
+  poll_until (status);
+  if (status != expect || type != expect_type) {
+    printf ("  %s %s: status %d type %d, expected %d %d\n",
+	    http_methods[method], path, status, type, expect, expect_type);
+    exit (1);
+  }
+}
+
+void add_time (char *name) { SE_Time_t *tm = type_alloc (SE_Time_t);
+  tm->href = strdup (name); tm->currentTime = time (NULL);
+  insert_resource (new_resource (sizeof (Resource), name, tm, SE_Time));
+}
+
+int main () {
+  char zero[16] = {0}; Address addr; SE_DeviceCapability_t *dcap;
+  struct timespec start, end; int i, out; double s;
+  printf ("IEEE 2030.5 server benchmark, %d requests\n", REQUESTS);
+  platform_init (); resource_init ();
+  ipv6_address (&addr, zero, 12354);
+  dcap = type_alloc (SE_DeviceCapability_t);
+  dcap->href = strdup ("/dcap"); dcap->pollRate = 900;
+  dcap->_flags = SE_TimeLink_exists | SE_EndDeviceListLink_exists;
+  dcap->TimeLink.href = strdup ("/tm");
+  dcap->EndDeviceListLink.href = strdup ("/edev");
+  insert_resource (new_resource (sizeof (Resource), "/dcap", dcap,
+				 SE_DeviceCapability));
+  add_time ("/edev/1/tm");
+  se_route ("/tm", time_handler); se_route ("/edev", edev_handler);
+  se_route ("/edev/1/tm", NULL);
+  acceptor = net_listen (&addr); new_server ();
+  client = se_connect (&addr, 0);
+  check ("/dcap", HTTP_GET, 200, SE_DeviceCapability);
+  check ("/tm", HTTP_GET, 200, SE_Time);
+  check ("/edev/1/tm", HTTP_GET, 200, SE_Time);
+  check ("/edev/2", HTTP_GET, 404, -1);
+  check ("/edevx", HTTP_GET, 404, -1);
+  check ("/edev", HTTP_POST, 201, -1);
+  check ("/dcap", HTTP_PUT, 405, -1);
+  printf ("  responses checked\n");
+  raw = type_alloc (HttpConnection);
+  http_init (raw, 1, "application/sep+xml", "application/sep+xml");
+  conn_connect (raw, &addr, 0); http_window (raw, WINDOW);
+  fflush (stdout); out = dup (1); // the requests are logged by se_receive
+  dup2 (open ("/dev/null", O_WRONLY), 1);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < REQUESTS; i++) http_get (raw, "/dcap");
+  poll_until (responses == REQUESTS);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  fflush (stdout); dup2 (out, 1);
+  s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf ("  %d responses, %.0f requests/s\n", responses, REQUESTS / s);
+  return REQUESTS / s < 1000;
+}
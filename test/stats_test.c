@@ -0,0 +1,45 @@
+#include "../pack.c"
+#include "../util.c"
+#include "../list.c"
+#include "../queue.c"
+#include "../pool.c"
+#include "../platform.c"
+
+// records event loop statistics for timer events, one timer is handled
+// quickly and the other exceeds the budget, the statistics are printed on
+// SIGUSR1
+
+#define ROUNDS 20
+#define BUDGET 5 // ms
+#define FAST EVENT_NEW
+#define SLOW (EVENT_NEW+1)
+
+int main () {
+  Timer *fast, *slow; void *any; int fired = 0;
+  struct timespec delay = {0, 10000000}; // 10 ms
+  LoopStats *s; EventStats *f, *w;
+  printf ("Event loop statistics test\n");
+  platform_init ();
+  s = event_stats_enable (BUDGET); event_stats_signal (SIGUSR1);
+  fast = add_timer (FAST); slow = add_timer (SLOW);
+  set_timer_ms (fast, 1); set_timer_ms (slow, 1);
+  while (fired < 2 * ROUNDS) {
+    switch (event_poll (&any, -1)) {
+    case SLOW: nanosleep (&delay, NULL);
+      if (++fired < 2 * ROUNDS) set_timer_ms (slow, 1); break;
+    case FAST:
+      if (++fired < 2 * ROUNDS) set_timer_ms (fast, 1); break;
+    }
+  }
+  raise (SIGUSR1); event_poll (&any, 0); // print the statistics
+  f = &s->type[FAST]; w = &s->type[SLOW];
+  if (s->stalls < w->count || f->max >= BUDGET * 1000) {
+    printf ("  stalls not detected\n"); return 1;
+  }
+  if (w->histogram[stats_bucket (10000)] + w->histogram[stats_bucket (10000)+1]
+      < w->count) {
+    printf ("  slow events not in the 10 ms bucket\n"); return 1;
+  }
+  printf ("  %ld stalls detected\n", (long)s->stalls);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include "../pack.c"
+#include "../util.c"
+#include "../list.c"
+#include "../queue.c"
+#include "../pool.c"
+#include "../platform.c"
+
+// measures TcpPort throughput over the loopback interface, build with and
+// without -DLINUX_URING to compare the epoll and io_uring backends
+
+#define TOTAL (512 << 20) // bytes streamed
+#define CHUNK 16384 // write size
+#define ROUNDS 50000 // request/response round trips
+#define MESSAGE 64 // request/response size
+
+TcpPort *client, *server;
+char data[CHUNK], buffer[CHUNK];
+long sent, received; int rounds, phase;
+
+double elapsed (struct timespec *start) { struct timespec end;
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec)
+    + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// write until the port would block or the stream is complete
+void stream (TcpPort *p) { int n;
+  while (sent < TOTAL && (n = net_write (p, data, CHUNK)) > 0) sent += n;
+}
+
+void client_event (TcpPort *p) { int n;
+  while ((n = net_read (p, buffer, CHUNK)) > 0) received += n;
+  if (phase == 0) stream (p);
+  else if (received == MESSAGE) {
+    received = 0;
+    if (++rounds < ROUNDS) net_write (p, data, MESSAGE);
+  }
+}
+
+void server_event (TcpPort *p) { int n;
+  while ((n = net_read (p, buffer, CHUNK)) > 0) {
+    if (phase == 0) received += n;
+    else net_write (p, buffer, n);
+  }
+}
+
+int main () {
+  char zero[16] = {0};
+  struct timespec start; Address addr;
+  int connected = 0, event; void *any;
+#ifdef LINUX_URING
+  printf ("TcpPort benchmark (io_uring)\n");
+#else
+  printf ("TcpPort benchmark (epoll)\n");
+#endif
+  platform_init ();
+  ipv6_address (&addr, zero, 12346);
+  client = new_tcp_port (); server = new_tcp_port ();
+  net_accept (server, net_listen (&addr));
+  net_connect (client, &addr);
+  while (connected < 2) {
+    event = event_poll (&any, -1);
+    switch (event) {
+    case TCP_ACCEPT: case TCP_CONNECT: connected++;
+    case TCP_PORT: net_read (any, buffer, CHUNK);
+    }
+  }
+  memset (data, 'x', CHUNK);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  stream (client);
+  while (received < TOTAL) {
+    event = event_poll (&any, -1);
+    if (event != TCP_PORT && event != TCP_WRITABLE) continue;
+    if (any == server) server_event (server);
+    else client_event (client);
+  }
+  printf ("  stream   %8.1f MB/s\n", TOTAL / elapsed (&start) / (1 << 20));
+  phase = 1; received = 0;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  net_write (client, data, MESSAGE);
+  while (rounds < ROUNDS) {
+    event = event_poll (&any, -1);
+    if (event != TCP_PORT && event != TCP_WRITABLE) continue;
+    if (any == server) server_event (server);
+    else client_event (client);
+  }
+  printf ("  request  %8.0f round trips/s\n", ROUNDS / elapsed (&start));
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include "../util.c"
 #include "../list.c"
 #include "../queue.c"
+#include "../pool.c"
 #include "../platform.c"
 // case TCP_PORT:
 //      TCP_CONNECT
@@ -23,7 +24,10 @@ int established (void *conn, int event) {
 }
 
 int closed (void *conn, int event) {
+  char buffer[1];
   switch (event) {
+  case TCP_PORT: // end of stream, closes the port
+    net_read (conn, buffer, 1); break;
   case TCP_CLOSED:
     if (conn == client) {
       printf ("  TCP_CLOSED: client side\n"); return 1;
@@ -35,15 +39,22 @@ int closed (void *conn, int event) {
 }
       
 int main () {
-  char zero[16] = {0};
-  int state = 0, event, cond;
+  char zero[16] = {0}, loopback[16] = {[15] = 1};
+  int state = 0, event, cond, s;
   Acceptor *a; void *any;
-  Address addr1, addr2;
-  address_copy (&addr1, ipv6_address (zero, 12345));
-  address_copy (&addr2, ipv6_address (zero, 54321));
+  Address addr1, addr2, addr3;
+  ipv6_address (&addr1, zero, 12345);
+  ipv6_address (&addr2, zero, 54321);
+  ipv6_address (&addr3, loopback, 12346);
   printf ("TcpPort test\n");
   platform_init ();
   a = net_listen (&addr1);
+  // the kernel completes connections to a listener without net_accept, a
+  // connect times out only when the accept queue (of length 1) is full
+  s = socket (AF_INET6, SOCK_STREAM, 0);
+  bind (s, (struct sockaddr *)&addr3, addr3.length); listen (s, 0);
+  connect (socket (AF_INET6, SOCK_STREAM, 0),
+	   (struct sockaddr *)&addr3, addr3.length);
   client = new_tcp_port ();
   server = new_tcp_port ();
   net_timeout (2);
@@ -78,7 +89,7 @@ int main () {
       cond |= closed (any, event);
       if (cond == 3) { cond = 0;
 	printf ("\ntest 4 - client connect timeout\n");
-	net_connect (client, &addr1); state++;
+	net_connect (client, &addr3); state++;
       } break;
     case 5:
       switch (event) {
@@ -91,7 +102,24 @@ int main () {
       } break;
     case 6:
       cond |= closed (any, event);
-      if (cond == 1) {
+      if (cond == 1) { cond = 0;
+	printf ("\ntest 6 - client idle timeout\n");
+	net_accept (server, a);
+	net_connect (client, &addr1); state++;
+      } break;
+    case 7:
+      cond |= established (any, event);
+      if (cond == 3) { cond = 0; set_timeout (client); state++; }
+      break;
+    case 8:
+      if (event == TCP_TIMEOUT && any == client) {
+	printf ("  TCP_TIMEOUT: client timed out\n");
+	net_close (client); net_close (server); state++;
+      } break;
+    case 9:
+      cond |= closed (any, event);
+      if (cond == 3) {
+	printf ("\nall tests passed\n"); return 0;
       }
     }
     event = event_poll (&any, -1);
@@ -0,0 +1,54 @@
+#include "../pack.c"
+#include "../util.c"
+#include "../list.c"
+#include "../queue.c"
+#include "../pool.c"
+#include "../platform.c"
+
+// measures the cost of timer operations on the timing wheel and the
+// accuracy of timer expiration
+
+#define TIMERS 100000
+#define FIRED 1000
+
+Timer *timers[TIMERS];
+
+double elapsed (struct timespec *start) { struct timespec end;
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9
+    + (end.tv_nsec - start->tv_nsec);
+}
+
+void bench (const char *name, int op) {
+  struct timespec start; int i;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < TIMERS; i++)
+    set_timer_ms (timers[i], op? 1 + rand () % 3600000 : 0);
+  printf ("  %-8s %6.1f ns/op\n", name, elapsed (&start) / TIMERS);
+}
+
+int main () {
+  int i, fired = 0, late = 0; void *any; uint64_t due[FIRED];
+  printf ("Timer benchmark, %d timers\n", TIMERS);
+  platform_init ();
+  for (i = 0; i < TIMERS; i++) timers[i] = add_timer (EVENT_NEW);
+  bench ("arm", 1); bench ("re-arm", 1); bench ("cancel", 0);
+  printf ("Timer expiration, %d timers\n", FIRED);
+  for (i = 0; i < FIRED; i++) {
+    int ms = 1 + rand () % 500;
+    timers[i]->node.data = &due[i];
+    set_timer_ms (timers[i], ms);
+    timers[i]->node.interval = 0;
+    due[i] = clock_ms () + ms;
+  }
+  while (fired < FIRED) {
+    if (event_poll (&any, -1) == EVENT_NEW) {
+      int64_t diff = clock_ms () - *(uint64_t *)any;
+      if (diff < 0) {
+	printf ("  timer expired %ld ms early\n", -diff); return 1;
+      } late = max (late, diff); fired++;
+    }
+  }
+  printf ("  all timers expired, maximum latency %d ms\n", late);
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include "../se_core.c"
+#include <openssl/pem.h>
+
+// measures the rate of TLS handshakes (each with a request and a shutdown)
+// over loopback, first with the client session cache disabled so every
+// handshake is a full handshake, then with the cache so the handshakes after
+// the first are resumed; checks a cache of one session is replaced when
+// connecting to another server and a session is not resumed once expired;
+// measures full handshakes with the verified certificate cache disabled and
+// enabled, counting the calls to the verify function, checks loading a CA
+// certificate clears the cache and the LFDI of the peer; then runs full
+// handshakes from several clients at once with the handshake steps on the
+// reactor thread and on workers, and measures the CPU time the reactor
+// thread takes handling events and the longest event
+
+#define HANDSHAKES 500
+#define CLIENTS 8
+#define WORKERS 2
+#define PORT 12361
+#define CERT "/tmp/tls_bench.pem"
+
+HttpConnection clients[CLIENTS];
+int started, responses, resumed, verified; uint64_t busy, longest;
+uint8_t known[20]; // LFDI of the certificate
+
+// write a self-signed ECDSA certificate and its private key to path
+void make_cert (const char *path) {
+  EVP_PKEY *key = EVP_EC_gen ("P-256"); X509 *x = X509_new ();
+  X509_NAME *name = X509_get_subject_name (x); FILE *f = fopen (path, "w");
+  ASN1_INTEGER_set (X509_get_serialNumber (x), 1);
+  X509_gmtime_adj (X509_getm_notBefore (x), 0);
+  X509_gmtime_adj (X509_getm_notAfter (x), 3600);
+  X509_NAME_add_entry_by_txt (name, "CN", MBSTRING_ASC,
+			      (uint8_t *)"tls_bench", -1, -1, 0);
+  X509_set_issuer_name (x, name); X509_set_pubkey (x, key);
+  X509_sign (x, key, EVP_sha256 ());
+  PEM_write_X509 (f, x); PEM_write_PrivateKey (f, key, 0, 0, 0, 0, 0);
+  fclose (f); X509_free (x); EVP_PKEY_free (key);
+}
+
+// CPU time of the reactor thread, not counting time taken by other threads
+uint64_t thread_us () { struct timespec t;
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+void check (int ok, const char *message) {
+  if (!ok) { printf ("  %s\n", message); exit (1); }
+}
+
+// accept the peer with the LFDI of the certificate, as a server would
+int verify (void *conn, uint8_t *cert, int length) { uint8_t lfdi[20];
+  lfdi_hash (lfdi, cert, length);
+  if (!verified++) memcpy (known, lfdi, 20);
+  return !memcmp (lfdi, known, 20);
+}
+
+void server_event (void *conn) {
+  if (conn_session (conn))
+    while (http_receive (conn) == HTTP_GET) http_respond (conn, 204);
+}
+
+void client_event (HttpConnection *c) {
+  switch (conn_session (c)) {
+  case SESSION_NEW: http_get (c, "/"); break;
+  case SESSION_CONNECTED:
+    if (http_receive (c) == HTTP_RESPONSE) { uint8_t lfdi[20];
+      check (http_status (c) == 204, "no response");
+      check (tls_peer_lfdi (c, lfdi) && !memcmp (lfdi, known, 20),
+	     "wrong peer LFDI");
+      responses++; resumed += tls_resumed (c); conn_close (c);
+    }
+  }
+}
+
+void connect_client (HttpConnection *c, Address *server) {
+  http_init (c, 1, "text/plain", "text/plain");
+  conn_connect (c, server, 1); started++;
+}
+
+int is_client (void *conn) {
+  return conn >= (void *)clients && conn < (void *)(clients + CLIENTS);
+}
+
+/* connect, make a request and close, n clients at once until the number of
+   handshakes is made, returns the handshakes per second */
+int run (Address *server, int n, int handshakes) {
+  uint64_t start = clock_ms (), t; void *any; int i, closed = 0;
+  started = responses = resumed = 0; busy = longest = 0;
+  for (i = 0; i < n; i++) connect_client (&clients[i], server);
+  while (closed < handshakes) {
+    int event = event_poll (&any, 5000); t = thread_us ();
+    switch (event) {
+    case TCP_ACCEPT: case TCP_PORT: case TCP_CONNECT: case TCP_WRITABLE:
+      if (is_client (any)) client_event (any);
+      else server_event (any);
+      break;
+    case TCP_CLOSED:
+      if (!is_client (any)) { se_recycle (any); break; }
+      closed++;
+      if (started < handshakes) connect_client (any, server);
+      break;
+    case TCP_TIMEOUT: case POLL_TIMEOUT: check (0, "no event");
+    }
+    t = thread_us () - t; busy += t; longest = max (longest, t);
+  }
+  check (responses == handshakes, "handshake failed");
+  t = clock_ms () - start; return handshakes * 1000 / max (t, 1);
+}
+
+// one handshake, returns 1 if the session was resumed
+int handshake (Address *server) { run (server, 1, 1); return resumed; }
+
+int main () {
+  Address local, server, other; Acceptor *a; int rate, i, n = 0;
+  printf ("TLS handshake benchmark, %d handshakes\n", HANDSHAKES);
+  platform_init (); make_cert (CERT);
+  tls_init (CERT, verify); load_cert (CERT);
+  ipv4_address (&local, 0, PORT); a = net_listen (&local);
+  ipv4_address (&server, 0x7f000001, PORT);
+  ipv4_address (&other, 0x7f000002, PORT);
+  se_accept_pool (a, 1, CLIENTS);
+
+  tls_session_cache (0, 0); rate = run (&server, 1, HANDSHAKES);
+  printf ("  session cache disabled: %d handshakes/s, %d resumed\n",
+	  rate, resumed);
+  check (resumed == 0, "session resumed without the cache");
+  tls_session_cache (32, 7200); rate = run (&server, 1, HANDSHAKES);
+  printf ("  session cache enabled: %d handshakes/s, %d resumed\n",
+	  rate, resumed);
+  check (resumed == HANDSHAKES - 1, "sessions not resumed");
+
+  tls_session_cache (1, 7200);
+  for (i = 0; i < 10; i++) n += handshake (i & 1? &server : &other);
+  check (n == 0, "session not replaced when the cache is full");
+  tls_session_cache (32, 1); handshake (&server); usleep (1100000);
+  check (!handshake (&server), "expired session resumed");
+  printf ("  sessions replaced when full and not resumed once expired\n");
+
+  tls_session_cache (0, 0);
+  for (i = 0; i < 2; i++) {
+    tls_verify_cache (i? 64 : 0); verified = 0;
+    rate = run (&server, 1, HANDSHAKES);
+    printf ("  verify cache %s: %d handshakes/s, %d certificates verified\n",
+	    i? "enabled" : "disabled", rate, verified);
+    check (i? verified <= 2 : verified == 2 * HANDSHAKES,
+	   "certificates verified");
+  }
+  load_cert (CERT); verified = 0; handshake (&server);
+  check (verified > 0, "cache not cleared by loading a CA certificate");
+
+  for (i = 0; i < 2; i++) {
+    if (i) tls_workers (WORKERS);
+    rate = run (&server, CLIENTS, HANDSHAKES);
+    printf ("  %d clients, %d workers: %d handshakes/s, reactor busy %d ms,"
+	    " longest event %d us\n", CLIENTS, i * WORKERS, rate,
+	    (int)(busy / 1000), (int)longest);
+  }
+  return 0;
+}
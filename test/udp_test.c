@@ -0,0 +1,46 @@
+#include "../se_core.c"
+
+// sends a burst of datagrams over loopback to a UdpPort that receives them
+// in batches (recvmmsg), checks every datagram arrives intact and in order
+// with its source address, replies to each one and checks the replies
+
+#define DATAGRAMS 100
+
+int main () {
+  char loopback[16] = {[15] = 1}, packet[64], *data;
+  Address to, from; UdpPort *server, *client; void *any;
+  int i, length, received = 0, replies = 0, events = 0;
+  printf ("UDP batch receive test, %d datagrams\n", DATAGRAMS);
+  platform_init ();
+  ipv6_address (&to, loopback, 12356); ipv6_address (&from, loopback, 12357);
+  server = new_udp_port (1500); client = new_udp_port (1500);
+  net_open (server, &to); net_open (client, &from);
+  for (i = 0; i < DATAGRAMS; i++) {
+    length = sprintf (packet, "datagram %d", i);
+    net_send (client, packet, length, &to);
+  }
+  while (replies < DATAGRAMS)
+    switch (event_poll (&any, 2000)) {
+    case UDP_PORT:
+      if (any == server) { events++;
+	while (data = net_receive_batch (server, &length)) {
+	  sprintf (packet, "datagram %d", received++);
+	  if (length != strlen (packet) || memcmp (data, packet, length)) {
+	    printf ("  datagram %d corrupted\n", received - 1); return 1;
+	  } net_reply (server, data, length);
+	}
+      } else
+	while (data = net_receive (client, &length)) {
+	  sprintf (packet, "datagram %d", replies++);
+	  if (length != strlen (packet) || memcmp (data, packet, length)) {
+	    printf ("  reply %d corrupted\n", replies - 1); return 1;
+	  }
+	} break;
+    case POLL_TIMEOUT:
+      printf ("  %d datagrams, %d replies received\n", received, replies);
+      return 1;
+    }
+  printf ("  %d datagrams in %d events, %d replies\n",
+	  received, events, replies);
+  return received != DATAGRAMS;
+}
@@ -20,6 +20,11 @@ void set_time (SE_Time_t *tm);
 */
 int64_t se_time ();
 
+/** @brief Get the current (adjusted) time in nanoseconds.
+    @returns the time returned by @ref se_time with nanosecond resolution
+*/
+int64_t se_time_ns ();
+
 /** @} */
 
 #include <time.h>
@@ -35,3 +40,8 @@ void set_time (SE_Time_t *tm) {
 int64_t se_time () {
   return time (NULL) + se_time_offset;
 }
+
+int64_t se_time_ns () { struct timespec t;
+  clock_gettime (CLOCK_REALTIME, &t);
+  return (t.tv_sec + se_time_offset) * 1000000000LL + t.tv_nsec;
+}
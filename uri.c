@@ -33,6 +33,13 @@ typedef struct {
   char buffer[128];
 } Uri128;
 
+/** A buffered URI instance type large enough for an HTTP request target */
+typedef struct {
+  Uri uri;
+  Address host;
+  char buffer[256];
+} Uri256;
+
 /** @brief Parse a URI.
     @param buf is a pointer to a buffered Uri
     @param href is a pointer to URI string